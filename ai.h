@@ -0,0 +1,278 @@
+#pragma once
+#include <array>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include "olcPixelGameEngine.h"
+#include "physics.h"
+#include "trajectory.h"
+#include "world.h"
+#include "thread_pool.h"
+
+// Read-only view of a terrain with a few explosion craters punched into it.
+// Lets a candidate shot see its own terrain destruction without copying the map.
+template <class TerrainT>
+class CraterTerrain {
+public:
+	static constexpr int max_craters = 4;
+
+private:
+	const TerrainT& base;
+	std::array<olc::vf2d, max_craters> centers;
+	std::array<float, max_craters> radii;
+	int n_craters = 0;
+
+public:
+	CraterTerrain(const TerrainT& base) : base(base) {}
+
+	void add_crater(const olc::vf2d& pos, float radius) {
+		if (n_craters < max_craters) {
+			centers[n_craters] = pos;
+			radii[n_craters] = radius;
+			n_craters++;
+		}
+	}
+
+	int get_width() const { return base.get_width(); }
+	int get_height() const { return base.get_height(); }
+	bool in_bounds(int x, int y) const { return base.in_bounds(x, y); }
+
+	float friction(int x, int y) const { return base.friction(x, y); }
+	float density(int x, int y) const { return base.density(x, y); }
+
+	// Each crater reaches into a material as far as Terrain::carve_crater() does
+	bool is_solid(int x, int y) const {
+		const MaterialProperties& m = base.material(x, y);
+		if (!m.solid) return false;
+		for (int i = 0; i < n_craters; i++) {
+			olc::vf2d d = olc::vf2d((float)x, (float)y) - centers[i];
+			float reach = radii[i] / m.hardness;
+			if (d.mag2() < reach * reach) return false;
+		}
+		return true;
+	}
+};
+
+enum AiDifficulty {
+	AI_EASY,
+	AI_NORMAL,
+	AI_HARD
+};
+
+struct AiWorm {
+	ProjectileState body;
+	int team = 0;
+};
+
+struct AiShot {
+	bool found = false;
+	float angle = 0;
+	float strength = 0;
+	float score = 0;
+	olc::vf2d impact;
+};
+
+// Picks a missile shot for one worm by simulating many (angle, strength) candidates in parallel.
+// Each candidate flies the real integrator, carves its crater into a CraterTerrain and throws
+// every worm with boom()'s knockback, then the outcome is scored from the shooter's team's view.
+// Candidates come from a seeded generator and are evaluated in fixed rounds, so given the same
+// seed and a search that finishes within its time budget the chosen shot is always the same.
+class ShotPlanner {
+public:
+	static constexpr int max_worms = 32;
+
+	struct Budget {
+		int initial_candidates;
+		int refine_rounds;
+		int refine_candidates;
+		float time_budget_ms;	// 0 means unlimited
+	};
+
+	int max_flight_frames = 600;
+	int max_settle_frames = 240;
+
+private:
+	Budget budget;
+	std::vector<olc::vf2d> candidates;	// (angle, strength)
+	std::vector<float> scores;
+	std::vector<olc::vf2d> impacts;
+
+	template <class TerrainT>
+	float evaluate(const TerrainT& terrain, const AiWorm* worms, int n_worms, int shooter, float angle, float strength, olc::vf2d& impact_out) const {
+		olc::vf2d dir = { cosf(angle), sinf(angle) };
+		ProjectileState missile;
+		missile.pos = worms[shooter].body.pos + dir * Missile::muzzle_offset;
+		missile.v = dir * strength * Missile::launch_speed;
+		missile.r = Missile::missile_r;
+		missile.friction = Missile::missile_friction;
+		missile.n_bounces = 0;
+
+		bool impact = false;
+		for (int frame = 0; frame < max_flight_frames && !impact && !missile.dead && !missile.stable; frame++) {
+			for (int i = 0; i < World::substeps; i++) {
+				if (integrate(missile, terrain, World::step_dt) && count_bounce(missile)) {
+					impact = true;
+					break;
+				}
+				if (missile.dead || missile.stable) break;
+			}
+		}
+		if (!impact) return -1000;
+		impact_out = missile.pos;
+
+		CraterTerrain<TerrainT> world(terrain);
+		world.add_crater(missile.pos, World::explosion_radius);
+
+		std::array<ProjectileState, max_worms> bodies;
+		for (int w = 0; w < n_worms; w++) {
+			ProjectileState& b = bodies[w];
+			b = worms[w].body;
+			olc::vf2d d = b.pos - missile.pos;
+			float div = powf(d.mag(), 2);
+			if (div < 0.1) div = 0.1f;
+			d /= div;
+			d *= World::explosion_radius * World::explosion_radius;
+			b.v = d;
+			b.stable = false;
+		}
+
+		for (int frame = 0; frame < max_settle_frames; frame++) {
+			bool settled = true;
+			for (int w = 0; w < n_worms; w++) {
+				ProjectileState& b = bodies[w];
+				if (b.stable || b.dead) continue;
+				settled = false;
+				for (int i = 0; i < World::substeps && !b.stable && !b.dead; i++) {
+					integrate(b, world, World::step_dt);
+				}
+			}
+			if (settled) break;
+		}
+
+		int team = worms[shooter].team;
+		float score = 0;
+		float nearest_enemy = 1e9f;
+		for (int w = 0; w < n_worms; w++) {
+			const ProjectileState& b = bodies[w];
+			float sign = worms[w].team == team ? -1.5f : 1.0f;
+			float dist = (worms[w].body.pos - missile.pos).mag();
+			if (b.dead) {
+				score += 100 * sign;
+			}
+			else {
+				score += std::min(50.0f, (b.pos - worms[w].body.pos).mag()) * sign;
+			}
+			float reach = World::explosion_radius + worms[w].body.r;
+			if (dist < reach) {
+				score += (1 - dist / reach) * 50 * sign;
+			}
+			if (worms[w].team != team) {
+				nearest_enemy = std::min(nearest_enemy, dist);
+			}
+		}
+		// Guides the search towards enemies when nothing is in reach yet
+		if (nearest_enemy < 1e9f) score -= nearest_enemy * 0.1f;
+		return score;
+	}
+
+	template <class TerrainT>
+	void evaluate_range(const TerrainT& terrain, const AiWorm* worms, int n_worms, int shooter, int begin, int end) {
+		ThreadPool::shared().parallel_for(begin, end, 4, [&](int b, int e) {
+			for (int i = b; i < e; i++) {
+				scores[i] = evaluate(terrain, worms, n_worms, shooter, candidates[i].x, candidates[i].y, impacts[i]);
+			}
+		});
+	}
+
+public:
+	ShotPlanner(AiDifficulty difficulty = AI_NORMAL) {
+		set_difficulty(difficulty);
+	}
+
+	void set_difficulty(AiDifficulty difficulty) {
+		switch (difficulty) {
+		case AI_EASY:
+			budget = { 16, 0, 0, 2 };
+			break;
+		case AI_NORMAL:
+			budget = { 64, 2, 16, 8 };
+			break;
+		case AI_HARD:
+			budget = { 256, 4, 32, 30 };
+			break;
+		}
+	}
+
+	void set_budget(const Budget& budget) { this->budget = budget; }
+	const Budget& get_budget() const { return budget; }
+
+	template <class TerrainT>
+	AiShot plan(const TerrainT& terrain, const AiWorm* worms, int n_worms, int shooter, uint32_t seed) {
+		AiShot best;
+		n_worms = std::min(n_worms, max_worms);
+		if (shooter < 0 || shooter >= n_worms) return best;
+
+		auto start = std::chrono::steady_clock::now();
+		auto over_budget = [&]() {
+			if (budget.time_budget_ms <= 0) return false;
+			std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			return elapsed.count() > budget.time_budget_ms;
+		};
+
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> unit(0, 1);
+		const float pi = 3.1415f;
+
+		// Stratified sweep over the upper half circle and the full charge range
+		candidates.clear();
+		int n = budget.initial_candidates;
+		int strengths = std::max(1, (int)std::sqrt((float)n / 4));
+		int angles = std::max(1, n / strengths);
+		for (int ai = 0; ai < angles; ai++) {
+			for (int si = 0; si < strengths; si++) {
+				float angle = -pi + (ai + unit(rng)) / angles * pi;
+				float strength = 0.1f + (si + unit(rng)) / strengths * 0.9f;
+				candidates.push_back({ angle, strength });
+			}
+		}
+		scores.assign(candidates.size(), 0);
+		impacts.assign(candidates.size(), {});
+		evaluate_range(terrain, worms, n_worms, shooter, 0, (int)candidates.size());
+
+		auto pick_best = [&]() {
+			int b = 0;
+			for (int i = 1; i < (int)candidates.size(); i++) {
+				if (scores[i] > scores[b]) b = i;
+			}
+			return b;
+		};
+
+		// Local refinement around the best shot so far, with a shrinking radius
+		float spread_angle = pi / angles;
+		float spread_strength = 0.9f / strengths;
+		for (int round = 0; round < budget.refine_rounds && !over_budget(); round++) {
+			olc::vf2d centre = candidates[pick_best()];
+			int begin = (int)candidates.size();
+			for (int i = 0; i < budget.refine_candidates; i++) {
+				float angle = centre.x + (unit(rng) * 2 - 1) * spread_angle;
+				float strength = std::clamp(centre.y + (unit(rng) * 2 - 1) * spread_strength, 0.05f, 1.0f);
+				candidates.push_back({ angle, strength });
+			}
+			scores.resize(candidates.size(), 0);
+			impacts.resize(candidates.size());
+			evaluate_range(terrain, worms, n_worms, shooter, begin, (int)candidates.size());
+			spread_angle *= 0.5f;
+			spread_strength *= 0.5f;
+		}
+
+		int b = pick_best();
+		best.found = scores[b] > -1000;
+		best.angle = candidates[b].x;
+		best.strength = candidates[b].y;
+		best.score = scores[b];
+		best.impact = impacts[b];
+		return best;
+	}
+};
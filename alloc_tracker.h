@@ -0,0 +1,141 @@
+#pragma once
+#include <atomic>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cassert>
+#include <new>
+
+// Opt-in accounting of every heap allocation, enabled by defining WORMS_TRACK_ALLOCATIONS.
+// The translation unit that defines ALLOC_TRACKER_APPLICATION before including this header gets
+// the replacement global operator new/delete, the same way OLC_PGE_APPLICATION pulls in the engine.
+//
+// Allocations count towards the frame and towards the innermost scope set on the allocating
+// thread (PROFILE_SCOPE sets its stage). NO_ALLOC_SCOPE marks code that must not allocate: any
+// allocation there is counted as a violation and, in debug builds, asserts. ALLOC_ALLOWED_SCOPE
+// exempts a known allocating call, such as spawning entities, inside such code.
+// Without WORMS_TRACK_ALLOCATIONS all of it compiles to nothing.
+struct AllocCounts {
+	uint64_t allocs = 0;
+	uint64_t frees = 0;
+	uint64_t bytes = 0;
+};
+
+struct AllocCounters {
+	std::atomic<uint64_t> allocs{ 0 };
+	std::atomic<uint64_t> frees{ 0 };
+	std::atomic<uint64_t> bytes{ 0 };
+
+	AllocCounts take() {
+		return { allocs.exchange(0, std::memory_order_relaxed), frees.exchange(0, std::memory_order_relaxed), bytes.exchange(0, std::memory_order_relaxed) };
+	}
+};
+
+class AllocTracker {
+public:
+	static constexpr int max_scopes = 16;
+
+#ifdef WORMS_TRACK_ALLOCATIONS
+	static constexpr bool enabled = true;
+#else
+	static constexpr bool enabled = false;
+#endif
+
+private:
+	inline static AllocCounters frame;
+	inline static std::array<AllocCounters, max_scopes> scopes;
+	inline static std::atomic<uint64_t> violations{ 0 };
+
+public:
+	inline static thread_local int scope = -1;
+	inline static thread_local int no_alloc_depth = 0;
+
+	static void on_alloc(size_t size) {
+		frame.allocs.fetch_add(1, std::memory_order_relaxed);
+		frame.bytes.fetch_add(size, std::memory_order_relaxed);
+		if (scope >= 0) {
+			scopes[scope].allocs.fetch_add(1, std::memory_order_relaxed);
+			scopes[scope].bytes.fetch_add(size, std::memory_order_relaxed);
+		}
+		if (no_alloc_depth > 0) {
+			violations.fetch_add(1, std::memory_order_relaxed);
+			assert(!"allocation inside an allocation-free scope");
+		}
+	}
+
+	static void on_free() {
+		frame.frees.fetch_add(1, std::memory_order_relaxed);
+		if (scope >= 0) scopes[scope].frees.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Counts since the last call, which starts the next frame
+	static AllocCounts take_frame() { return frame.take(); }
+	static AllocCounts take_scope(int scope) { return scopes[scope].take(); }
+	static uint64_t get_violations() { return violations.load(std::memory_order_relaxed); }
+};
+
+// Attributes the allocations of the enclosing block on this thread to a scope
+class AllocScope {
+	int previous;
+
+public:
+	AllocScope(int scope) : previous(AllocTracker::scope) { AllocTracker::scope = scope; }
+	~AllocScope() { AllocTracker::scope = previous; }
+};
+
+class NoAllocScope {
+public:
+	NoAllocScope() { AllocTracker::no_alloc_depth++; }
+	~NoAllocScope() { AllocTracker::no_alloc_depth--; }
+};
+
+class AllocAllowedScope {
+	int previous;
+
+public:
+	AllocAllowedScope() : previous(AllocTracker::no_alloc_depth) { AllocTracker::no_alloc_depth = 0; }
+	~AllocAllowedScope() { AllocTracker::no_alloc_depth = previous; }
+};
+
+#define ALLOC_CONCAT_(a, b) a##b
+#define ALLOC_CONCAT(a, b) ALLOC_CONCAT_(a, b)
+#ifdef WORMS_TRACK_ALLOCATIONS
+#define NO_ALLOC_SCOPE() NoAllocScope ALLOC_CONCAT(no_alloc_scope_, __LINE__)
+#define ALLOC_ALLOWED_SCOPE() AllocAllowedScope ALLOC_CONCAT(alloc_allowed_scope_, __LINE__)
+#else
+#define NO_ALLOC_SCOPE()
+#define ALLOC_ALLOWED_SCOPE()
+#endif
+
+#if defined(WORMS_TRACK_ALLOCATIONS) && defined(ALLOC_TRACKER_APPLICATION)
+#undef ALLOC_TRACKER_APPLICATION
+
+void* operator new(size_t size) {
+	AllocTracker::on_alloc(size);
+	if (void* p = malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+	if (!p) return;
+	AllocTracker::on_free();
+	free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	operator delete(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	operator delete(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+	operator delete(p);
+}
+#endif
@@ -0,0 +1,212 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include "olcPixelGameEngine.h"
+
+// A named rectangle of an atlas texture, ready to be drawn through a SpriteBatch
+struct AtlasSprite {
+	olc::Decal* decal = nullptr;
+	olc::vf2d size;	// in pixels
+	olc::vf2d uv_pos;
+	olc::vf2d uv_size = { 1, 1 };
+
+	explicit operator bool() const { return decal != nullptr; }
+};
+
+// All game sprites packed into a single texture.
+//
+// The build step (the game run with --build-atlas, hooked up as a post-build event) decodes the
+// source PNGs, downscales them, shelf-packs them and writes one .atlas file: a header, the
+// name -> rect index and the raw RGBA pixels. At runtime load() pulls that file in with a single
+// read and no image decoding. If the file is missing, pack() does the same work in memory.
+//
+// File layout, little endian:
+//   char[4] "WATL", u32 version, u32 width, u32 height, u32 count,
+//   count x { u8 name length, name bytes, i32 x, i32 y, i32 w, i32 h },
+//   width * height RGBA pixels
+class Atlas {
+	struct Rect {
+		int x = 0;
+		int y = 0;
+		int w = 0;
+		int h = 0;
+	};
+
+	static constexpr uint32_t version = 1;
+
+	std::unique_ptr<olc::Sprite> sprite;
+	std::unique_ptr<olc::Decal> decal;
+	std::unordered_map<std::string, Rect> index;
+
+	// Box filter so that no side exceeds max_size
+	static std::unique_ptr<olc::Sprite> downscale(olc::Sprite& src, int max_size) {
+		int factor = 1;
+		while (src.width / factor > max_size || src.height / factor > max_size) factor++;
+		if (factor == 1) return std::unique_ptr<olc::Sprite>(src.Duplicate());
+
+		int w = std::max(1, src.width / factor);
+		int h = std::max(1, src.height / factor);
+		auto dst = std::make_unique<olc::Sprite>(w, h);
+		for (int y = 0; y < h; y++) {
+			for (int x = 0; x < w; x++) {
+				int r = 0, g = 0, b = 0, a = 0;
+				for (int sy = 0; sy < factor; sy++) {
+					for (int sx = 0; sx < factor; sx++) {
+						olc::Pixel p = src.GetPixel(x * factor + sx, y * factor + sy);
+						// Premultiply so transparent texels do not bleed their colour into the edges
+						r += p.r * p.a; g += p.g * p.a; b += p.b * p.a; a += p.a;
+					}
+				}
+				int n = factor * factor;
+				if (a == 0) dst->SetPixel(x, y, olc::Pixel(0, 0, 0, 0));
+				else dst->SetPixel(x, y, olc::Pixel(r / a, g / a, b / a, a / n));
+			}
+		}
+		return dst;
+	}
+
+	bool pack_sprites(const std::vector<std::string>& names, std::vector<std::unique_ptr<olc::Sprite>>& images) {
+		const int padding = 1;
+		int total_area = 0;
+		int widest = 0;
+		for (auto& img : images) {
+			total_area += (img->width + padding) * (img->height + padding);
+			widest = std::max(widest, img->width + padding);
+		}
+		int width = 1;
+		while (width < widest || width * width < total_area) width *= 2;
+
+		// Shelf packing, tallest first
+		std::vector<int> order(images.size());
+		for (int i = 0; i < (int)order.size(); i++) order[i] = i;
+		std::sort(order.begin(), order.end(), [&](int a, int b) { return images[a]->height > images[b]->height; });
+
+		std::vector<Rect> rects(images.size());
+		int x = 0, y = 0, shelf = 0;
+		for (int i : order) {
+			if (x + images[i]->width > width) {
+				x = 0;
+				y += shelf + padding;
+				shelf = 0;
+			}
+			rects[i] = { x, y, images[i]->width, images[i]->height };
+			x += images[i]->width + padding;
+			shelf = std::max(shelf, images[i]->height);
+		}
+		int height = 1;
+		while (height < y + shelf) height *= 2;
+
+		sprite = std::make_unique<olc::Sprite>(width, height);
+		std::fill(sprite->GetData(), sprite->GetData() + width * height, olc::Pixel(0, 0, 0, 0));
+		index.clear();
+		for (int i = 0; i < (int)images.size(); i++) {
+			for (int py = 0; py < rects[i].h; py++) {
+				for (int px = 0; px < rects[i].w; px++) {
+					sprite->SetPixel(rects[i].x + px, rects[i].y + py, images[i]->GetPixel(px, py));
+				}
+			}
+			index[names[i]] = rects[i];
+		}
+		return true;
+	}
+
+public:
+	// Decodes and packs the given image files. Each sprite is named after its file.
+	bool pack(const std::vector<std::string>& files, int max_size = 128) {
+		std::vector<std::unique_ptr<olc::Sprite>> images;
+		for (auto& file : files) {
+			olc::Sprite src;
+			if (src.LoadFromFile(file) != olc::rcode::OK) return false;
+			images.push_back(downscale(src, max_size));
+		}
+		return pack_sprites(files, images);
+	}
+
+	bool save(const std::string& file) const {
+		if (!sprite) return false;
+		std::vector<char> data;
+		auto put = [&](const void* src, size_t n) {
+			const char* c = (const char*)src;
+			data.insert(data.end(), c, c + n);
+		};
+		auto put_u32 = [&](uint32_t v) { put(&v, 4); };
+
+		put("WATL", 4);
+		put_u32(version);
+		put_u32(sprite->width);
+		put_u32(sprite->height);
+		put_u32((uint32_t)index.size());
+		for (auto& [name, rect] : index) {
+			uint8_t len = (uint8_t)std::min<size_t>(name.size(), 255);
+			put(&len, 1);
+			put(name.data(), len);
+			put_u32(rect.x);
+			put_u32(rect.y);
+			put_u32(rect.w);
+			put_u32(rect.h);
+		}
+		put(sprite->GetData(), (size_t)sprite->width * sprite->height * 4);
+
+		std::ofstream out(file, std::ios::binary);
+		out.write(data.data(), data.size());
+		return (bool)out;
+	}
+
+	// Reads a file written by save() in one go
+	bool load(const std::string& file) {
+		std::ifstream in(file, std::ios::binary | std::ios::ate);
+		if (!in) return false;
+		std::vector<char> data((size_t)in.tellg());
+		in.seekg(0);
+		if (!in.read(data.data(), data.size())) return false;
+
+		size_t at = 0;
+		auto get = [&](void* dst, size_t n) {
+			if (at + n > data.size()) return false;
+			memcpy(dst, data.data() + at, n);
+			at += n;
+			return true;
+		};
+		uint32_t header[5];
+		if (!get(header, sizeof(header)) || memcmp(header, "WATL", 4) != 0 || header[1] != version) return false;
+		uint32_t width = header[2], height = header[3], count = header[4];
+
+		index.clear();
+		for (uint32_t i = 0; i < count; i++) {
+			uint8_t len;
+			char name[256];
+			int32_t rect[4];
+			if (!get(&len, 1) || !get(name, len) || !get(rect, sizeof(rect))) return false;
+			index[std::string(name, len)] = { rect[0], rect[1], rect[2], rect[3] };
+		}
+
+		if (data.size() - at != (size_t)width * height * 4) return false;
+		sprite = std::make_unique<olc::Sprite>(width, height);
+		memcpy(sprite->GetData(), data.data() + at, (size_t)width * height * 4);
+		return true;
+	}
+
+	// Uploads the texture. Needs the render thread.
+	void create_decal() {
+		if (sprite) decal = std::make_unique<olc::Decal>(sprite.get());
+	}
+
+	// An empty AtlasSprite if name is unknown or the decal has not been created yet
+	AtlasSprite get(const std::string& name) const {
+		AtlasSprite s;
+		auto it = index.find(name);
+		if (it == index.end() || !decal) return s;
+		const Rect& r = it->second;
+		s.decal = decal.get();
+		s.size = { (float)r.w, (float)r.h };
+		s.uv_pos = { (float)r.x / sprite->width, (float)r.y / sprite->height };
+		s.uv_size = { (float)r.w / sprite->width, (float)r.h / sprite->height };
+		return s;
+	}
+};
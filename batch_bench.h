@@ -0,0 +1,47 @@
+#pragma once
+#include <chrono>
+#include <random>
+#include <vector>
+#include <iostream>
+#include "batch_env.h"
+
+// Steps BatchEnv batches of a few sizes with random shots and reports environment steps per
+// second, the throughput a training loop gets. Every batch first plays warmup steps, so the
+// matches are spread over all phases of a game when timing starts.
+// Started with --bench-batch.
+inline void run_batch_benchmark(std::ostream& out) {
+	const int sizes[] = { 1, 8, 32, 128 };
+	const int warmup = 200;
+	const double seconds = 2;
+
+	using clock = std::chrono::steady_clock;
+	for (int n : sizes) {
+		BatchEnv env(n, BatchEnvConfig(), 1);
+		std::vector<EnvAction> actions(n);
+		std::mt19937 rng(7);
+		std::uniform_real_distribution<float> angle(-2.5f, -0.6f);
+		std::uniform_real_distribution<float> strength(0.3f, 1.0f);
+		auto random_actions = [&]() {
+			for (auto& a : actions) a = { angle(rng), strength(rng) };
+		};
+
+		for (int s = 0; s < warmup; s++) {
+			random_actions();
+			env.step(actions.data());
+		}
+
+		uint64_t start_steps = env.get_steps();
+		int episodes = 0;
+		auto start = clock::now();
+		double elapsed = 0;
+		while (elapsed < seconds) {
+			random_actions();
+			env.step(actions.data());
+			for (int i = 0; i < n; i++) episodes += env.get_dones()[i];
+			elapsed = std::chrono::duration<double>(clock::now() - start).count();
+		}
+		uint64_t steps = env.get_steps() - start_steps;
+		out << n << " envs: " << (uint64_t)(steps / elapsed) << " env-steps/s, " << episodes / elapsed
+			<< " episodes/s (" << ThreadPool::shared().get_threads() << " threads)\n";
+	}
+}
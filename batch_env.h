@@ -0,0 +1,237 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include "olcPixelGameEngine.h"
+#include "world.h"
+#include "thread_pool.h"
+
+struct EnvAction {
+	float angle = 0;
+	float strength = 0;
+};
+
+struct BatchEnvConfig {
+	int width = 800;
+	int height = 400;
+	int worms_per_team = 2;
+	int max_turns = 20;
+	int frame_skip = 1;
+	float dt = 1.0f / 60;
+	int obs_level = 1;	// occupancy pyramid level used as the downsampled terrain
+};
+
+// N independent two-team matches stepped together for bot training.
+// One step() advances every world by frame_skip physics frames on the shared thread pool.
+// Observations, rewards and flags live in preallocated contiguous arrays indexed by environment,
+// so stepping never reallocates them. Finished environments restart on their next step.
+class BatchEnv {
+	struct Env {
+		World world;
+		std::vector<EntityHandle> worms;
+		int turn_team = 0;
+		int turns = 0;
+		int shooter = 0;
+
+		Env(uint32_t seed) : world(seed) {}
+	};
+
+	BatchEnvConfig config;
+	std::vector<Env> envs;
+	int obs_tiles_x = 0;
+	int obs_tiles_y = 0;
+	int obs_size = 0;
+	uint64_t steps = 0;
+
+	std::vector<float> observations;
+	std::vector<float> rewards;
+	std::vector<uint8_t> dones;
+	std::vector<uint8_t> awaiting_action;
+
+	int max_worms() const { return config.worms_per_team * 2; }
+
+	// nullptr once the worm died
+	Worm* get_worm(Env& env, int w) {
+		Worm* worm = env.world.objects.get<Worm>(env.worms[w]);
+		return worm && !worm->dead ? worm : nullptr;
+	}
+
+	int count_alive(Env& env, int team) {
+		int n = 0;
+		for (int w = 0; w < max_worms(); w++) {
+			Worm* worm = get_worm(env, w);
+			if (worm && worm->team == team) n++;
+		}
+		return n;
+	}
+
+	// Index of the next living worm of the team whose turn it is, cycling through its members
+	int pick_shooter(Env& env) {
+		for (int k = 1; k <= max_worms(); k++) {
+			int w = (env.shooter + k) % max_worms();
+			Worm* worm = get_worm(env, w);
+			if (worm && worm->team == env.turn_team) return w;
+		}
+		return -1;
+	}
+
+	void step_env(int i, const EnvAction& action) {
+		Env& env = envs[i];
+		World& world = env.world;
+		rewards[i] = 0;
+		dones[i] = 0;
+
+		switch (world.phase) {
+		case LOADING:	// only the game loads assets
+		case RESET:
+			world.objects.clear();
+			std::fill(env.worms.begin(), env.worms.end(), EntityHandle());
+			env.turn_team = 0;
+			env.turns = 0;
+			env.shooter = max_worms() - 1;
+			world.phase = GENERATE_TERRAIN;
+			break;
+
+		case GENERATE_TERRAIN:
+			world.generate_terrain(config.width, config.height);
+			world.phase = DEPLOY_TROOPS;
+			break;
+
+		case DEPLOY_TROOPS: {
+			// Team 0 on the left half, team 1 on the right half
+			std::uniform_real_distribution<float> unit(0.1f, 0.9f);
+			for (int w = 0; w < max_worms(); w++) {
+				int team = w % 2;
+				float x = (team + unit(world.rng)) * config.width / 2;
+				env.worms[w] = world.deploy_troop({ x, 20 }, team);
+			}
+			world.phase = DEPLOYING_TROOPS;
+			break;
+		}
+
+		case DEPLOYING_TROOPS:
+			if (world.are_all_stable()) world.phase = START_PLAY;
+			break;
+
+		case START_PLAY: {
+			env.shooter = pick_shooter(env);
+			if (env.shooter < 0) {
+				world.phase = RESET;
+				dones[i] = 1;
+				break;
+			}
+			Worm* worm = get_worm(env, env.shooter);
+			olc::vf2d dir = { cosf(action.angle), sinf(action.angle) };
+			float strength = std::clamp(action.strength, 0.0f, 1.0f);
+			world.spawn_missile(worm->pos + dir * Missile::muzzle_offset, dir * strength * Missile::launch_speed);
+			world.phase = CAMERA_MODE;
+			break;
+		}
+
+		case CAMERA_MODE:
+			if (world.are_all_stable()) {
+				env.turn_team ^= 1;
+				env.turns++;
+				world.phase = START_PLAY;
+			}
+			break;
+		}
+
+		int alive0 = count_alive(env, 0);
+		int alive1 = count_alive(env, 1);
+		for (int f = 0; f < config.frame_skip; f++) {
+			world.step(config.dt);
+		}
+		world.remove_dead();
+
+		// Zero-sum, from team 0's point of view: one point per enemy worm lost, minus one per own worm lost
+		rewards[i] = (float)(alive1 - count_alive(env, 1)) - (float)(alive0 - count_alive(env, 0));
+
+		bool deployed = world.phase == START_PLAY || world.phase == CAMERA_MODE;
+		if (deployed && (count_alive(env, 0) == 0 || count_alive(env, 1) == 0 || env.turns >= config.max_turns)) {
+			dones[i] = 1;
+			world.phase = RESET;
+		}
+		awaiting_action[i] = world.phase == START_PLAY;
+		write_observation(i);
+	}
+
+	void write_observation(int i) {
+		Env& env = envs[i];
+		float* obs = observations.data() + (size_t)i * obs_size;
+
+		const OccupancyPyramid& occupancy = env.world.terrain.get_occupancy();
+		if (occupancy.get_levels() > config.obs_level && occupancy.tiles_x(config.obs_level) == obs_tiles_x) {
+			for (int ty = 0; ty < obs_tiles_y; ty++) {
+				for (int tx = 0; tx < obs_tiles_x; tx++) {
+					Occupancy state = occupancy.get(config.obs_level, tx, ty);
+					*obs++ = state == SOLID ? 1.0f : state == MIXED ? 0.5f : 0.0f;
+				}
+			}
+		}
+		else {
+			std::fill(obs, obs + obs_tiles_x * obs_tiles_y, 0.0f);
+			obs += obs_tiles_x * obs_tiles_y;
+		}
+
+		for (int w = 0; w < max_worms(); w++) {
+			const Worm* worm = get_worm(env, w);
+			*obs++ = worm ? worm->pos.x / config.width : 0;
+			*obs++ = worm ? worm->pos.y / config.height : 0;
+			*obs++ = worm ? (float)worm->team : 0;
+			*obs++ = worm ? 1.0f : 0.0f;
+		}
+		*obs++ = (float)env.turn_team;
+		*obs++ = env.shooter >= 0 ? (float)env.shooter : 0;
+	}
+
+public:
+	BatchEnv(int n, const BatchEnvConfig& config = BatchEnvConfig(), uint32_t seed = 0) : config(config) {
+		envs.reserve(n);
+		for (int i = 0; i < n; i++) {
+			envs.emplace_back(seed + i);
+			envs.back().worms.assign(max_worms(), EntityHandle());
+		}
+
+		int tile = 8 << config.obs_level;
+		obs_tiles_x = (config.width + tile - 1) / tile;
+		obs_tiles_y = (config.height + tile - 1) / tile;
+		obs_size = obs_tiles_x * obs_tiles_y + max_worms() * 4 + 2;
+
+		observations.assign((size_t)n * obs_size, 0);
+		rewards.assign(n, 0);
+		dones.assign(n, 0);
+		awaiting_action.assign(n, 0);
+	}
+
+	// actions holds one entry per environment. An entry is only used by environments whose
+	// awaiting_action flag was set by the previous step; the rest ignore it.
+	void step(const EnvAction* actions) {
+		ThreadPool::shared().parallel_for(0, (int)envs.size(), 1, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				step_env(i, actions[i]);
+			}
+		});
+		steps += envs.size();
+	}
+
+	void reset_all() {
+		for (auto& env : envs) env.world.phase = RESET;
+	}
+
+	int get_size() const { return (int)envs.size(); }
+	uint64_t get_steps() const { return steps; }
+
+	// Per environment: obs_tiles_x * obs_tiles_y terrain occupancy values (0 sky, 0.5 mixed, 1 solid),
+	// then x, y, team and alive for every worm slot, then the team to move and the shooting worm.
+	int get_observation_size() const { return obs_size; }
+	int get_obs_tiles_x() const { return obs_tiles_x; }
+	int get_obs_tiles_y() const { return obs_tiles_y; }
+	const float* get_observations() const { return observations.data(); }
+	const float* get_rewards() const { return rewards.data(); }
+	const uint8_t* get_dones() const { return dones.data(); }
+	const uint8_t* get_awaiting_action() const { return awaiting_action.data(); }
+
+	World& get_world(int i) { return envs[i].world; }
+};
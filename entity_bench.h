@@ -0,0 +1,87 @@
+#pragma once
+#include <chrono>
+#include <random>
+#include <iostream>
+#include <type_traits>
+#include "olcPixelGameEngine.h"
+#include "world.h"
+#include "sprite_batch.h"
+
+// Measures what one entity costs per frame: World::step() over worms and debris dropped above
+// a generated map, and drawing them into a SpriteBatch. Dummies draw with the canvas directly
+// and are left out, and so is flush(): the batch is only filled, which is the per-object part.
+// Started with --bench-entities.
+inline void run_entity_benchmark(std::ostream& out) {
+	const int counts[] = { 1000, 10000 };
+	const int step_frames = 120;
+	const int draw_frames = 100;
+
+	using clock = std::chrono::steady_clock;
+	auto elapsed_ns = [](clock::time_point start) {
+		return std::chrono::duration<double, std::nano>(clock::now() - start).count();
+	};
+
+	// The decal is only the batch's key until flush(), so any address stands in for the atlas
+	static char placeholder_texture;
+	AtlasSprite sprite;
+	sprite.decal = reinterpret_cast<olc::Decal*>(&placeholder_texture);
+	sprite.size = { 16, 16 };
+	AtlasSprite saved[3] = { Worm::sprite, Debris::sprite, Missile::sprite };
+	Worm::sprite = Debris::sprite = Missile::sprite = sprite;
+
+	olc::PixelGameEngine canvas;
+	canvas.Construct(1280, 720, 1, 1);
+	SpriteBatch batch;
+
+	for (int n : counts) {
+		World world(1);
+		world.generate_terrain(1280, 720);
+		std::uniform_real_distribution<float> unit(0, 1);
+		for (int i = 0; i < n; i++) {
+			float x = 8 + unit(world.rng) * (world.terrain.get_width() - 16);
+			olc::vf2d pos = { x, world.terrain.get_surface().get((int)x) - 20 - unit(world.rng) * 200 };
+			olc::vf2d v = { unit(world.rng) * 40 - 20, unit(world.rng) * -20 };
+			if (i % 2) {
+				world.objects.get<Worm>(world.deploy_troop(pos, i % 4 / 2))->v = v;
+			}
+			else {
+				Debris d;
+				d.pos = pos;
+				d.v = v;
+				d.set_size(2.5f);
+				world.objects.add(d);
+			}
+		}
+
+		long long moving = 0;
+		double step_ns = 0;
+		for (int f = 0; f < step_frames; f++) {
+			world.objects.for_each([&](PhysicsObject& obj) { moving += !obj.stable; });
+			auto start = clock::now();
+			world.step(World::step_dt);
+			step_ns += elapsed_ns(start);
+			world.remove_dead();
+		}
+
+		int drawn = 0;
+		auto start = clock::now();
+		for (int f = 0; f < draw_frames; f++) {
+			batch.begin(canvas);
+			world.objects.for_each_kind([&](auto& items) {
+				using T = typename std::decay_t<decltype(items)>::value_type;
+				if constexpr (!std::is_same_v<T, Dummy>) {
+					for (auto& obj : items) obj.draw(batch, { 0, 0 });
+				}
+			});
+			drawn += batch.get_drawn() + batch.get_culled();
+		}
+		double draw_ns = elapsed_ns(start);
+
+		out << n << " entities: step " << step_ns / std::max(1LL, moving) << " ns per moving object ("
+			<< moving / step_frames << " moving on average), draw " << draw_ns / std::max(1, drawn) << " ns per sprite\n";
+	}
+
+	Worm::sprite = saved[0];
+	Debris::sprite = saved[1];
+	Missile::sprite = saved[2];
+}
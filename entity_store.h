@@ -0,0 +1,176 @@
+#pragma once
+#include <vector>
+#include <tuple>
+#include <cstdint>
+#include <utility>
+#include <type_traits>
+
+// Generation-checked reference to an entity. Resolving it after the entity was removed yields
+// nullptr instead of a dangling pointer, even if the slot has been reused since.
+struct EntityHandle {
+	uint32_t slot = ~0u;
+	uint32_t generation = 0;
+
+	bool operator==(const EntityHandle& rhs) const { return slot == rhs.slot && generation == rhs.generation; }
+	bool operator!=(const EntityHandle& rhs) const { return !(*this == rhs); }
+};
+
+template <class T, class... Ts>
+struct type_index;
+
+template <class T, class... Ts>
+struct type_index<T, T, Ts...> : std::integral_constant<int, 0> {};
+
+template <class T, class U, class... Ts>
+struct type_index<T, U, Ts...> : std::integral_constant<int, 1 + type_index<T, Ts...>::value> {};
+
+// Stores each entity kind by value in its own contiguous array.
+// Removal swaps the last element into the hole, so iteration is always a linear walk over live
+// entities. A slot table maps handles to (kind, index) and is patched whenever an element moves.
+// Every Ts needs a bool dead member, which remove_dead() uses.
+template <class... Ts>
+class EntityStore {
+	template <class T>
+	struct Array {
+		std::vector<T> items;
+		std::vector<uint32_t> owners;	// slot of each item
+	};
+
+	struct Slot {
+		uint32_t generation = 0;
+		uint32_t index = 0;
+		int kind = -1;
+	};
+
+	std::tuple<Array<Ts>...> arrays;
+	std::vector<Slot> slots;
+	std::vector<uint32_t> free_slots;
+
+	uint32_t allocate_slot(int kind, uint32_t index) {
+		uint32_t slot;
+		if (!free_slots.empty()) {
+			slot = free_slots.back();
+			free_slots.pop_back();
+		}
+		else {
+			slot = (uint32_t)slots.size();
+			slots.emplace_back();
+		}
+		slots[slot].kind = kind;
+		slots[slot].index = index;
+		return slot;
+	}
+
+	void release_slot(uint32_t slot) {
+		slots[slot].generation++;
+		slots[slot].kind = -1;
+		free_slots.push_back(slot);
+	}
+
+	const Slot* resolve(const EntityHandle& h) const {
+		if (h.slot >= slots.size()) return nullptr;
+		const Slot& s = slots[h.slot];
+		if (s.kind < 0 || s.generation != h.generation) return nullptr;
+		return &s;
+	}
+
+	template <class T>
+	void remove_dead_of() {
+		Array<T>& a = std::get<Array<T>>(arrays);
+		for (size_t i = 0; i < a.items.size();) {
+			if (!a.items[i].dead) {
+				i++;
+				continue;
+			}
+			release_slot(a.owners[i]);
+			if (i + 1 != a.items.size()) {
+				a.items[i] = std::move(a.items.back());
+				a.owners[i] = a.owners.back();
+				slots[a.owners[i]].index = (uint32_t)i;
+			}
+			a.items.pop_back();
+			a.owners.pop_back();
+		}
+	}
+
+	template <class Base, size_t... I>
+	Base* get_as(const Slot& s, std::index_sequence<I...>) {
+		Base* result = nullptr;
+		((s.kind == (int)I ? (result = &std::get<I>(arrays).items[s.index], 0) : 0), ...);
+		return result;
+	}
+
+public:
+	static constexpr int kind_count = sizeof...(Ts);
+
+	template <class T>
+	static constexpr int kind_of() { return type_index<T, Ts...>::value; }
+
+	template <class T>
+	EntityHandle add(T obj) {
+		Array<T>& a = std::get<Array<T>>(arrays);
+		uint32_t slot = allocate_slot(kind_of<T>(), (uint32_t)a.items.size());
+		a.items.push_back(std::move(obj));
+		a.owners.push_back(slot);
+		return { slot, slots[slot].generation };
+	}
+
+	// Typed lookup. nullptr if the handle is stale or refers to another kind.
+	template <class T>
+	T* get(const EntityHandle& h) {
+		const Slot* s = resolve(h);
+		if (!s || s->kind != kind_of<T>()) return nullptr;
+		return &std::get<Array<T>>(arrays).items[s->index];
+	}
+
+	// Lookup through a common base class of every kind. nullptr if the handle is stale.
+	template <class Base>
+	Base* get_base(const EntityHandle& h) {
+		const Slot* s = resolve(h);
+		if (!s) return nullptr;
+		return get_as<Base>(*s, std::index_sequence_for<Ts...>{});
+	}
+
+	template <class T>
+	EntityHandle handle_of(size_t index) const {
+		uint32_t slot = std::get<Array<T>>(arrays).owners[index];
+		return { slot, slots[slot].generation };
+	}
+
+	template <class T>
+	std::vector<T>& all() { return std::get<Array<T>>(arrays).items; }
+
+	template <class T>
+	const std::vector<T>& all() const { return std::get<Array<T>>(arrays).items; }
+
+	// Calls fn(items) once per kind with that kind's std::vector, so fn is instantiated per concrete type.
+	// fn may add entities while it runs; it must then index into the vector rather than hold references.
+	template <class Fn>
+	void for_each_kind(Fn fn) {
+		(fn(std::get<Array<Ts>>(arrays).items), ...);
+	}
+
+	// Calls fn(obj) for every entity, kind by kind. Must not add or remove entities.
+	template <class Fn>
+	void for_each(Fn fn) {
+		for_each_kind([&](auto& items) {
+			for (auto& obj : items) fn(obj);
+		});
+	}
+
+	size_t size() const {
+		return (std::get<Array<Ts>>(arrays).items.size() + ...);
+	}
+
+	// Swap-and-pop every entity flagged dead. Invalidates their handles.
+	void remove_dead() {
+		(remove_dead_of<Ts>(), ...);
+	}
+
+	void clear() {
+		for (uint32_t i = 0; i < slots.size(); i++) {
+			if (slots[i].kind >= 0) release_slot(i);
+		}
+		((std::get<Array<Ts>>(arrays).items.clear(), std::get<Array<Ts>>(arrays).owners.clear()), ...);
+	}
+};
@@ -0,0 +1,123 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "terrain.h"
+
+// Finds terrain that an explosion cut loose and turns it into sand, which FallingSand then drops.
+//
+// Structural cells (solid and not granular) are anchored when they connect to the bottom row.
+// check() floods from every structural cell around an explosion. The flood is depth first and
+// tries the cell below before the sides and the one above, so ground under the crater usually
+// reaches the bottom row after a few hundred cells, and stops there. It also stops on reaching
+// a cell an earlier flood of the same check found anchored. A flood that runs out of cells to
+// visit is an island.
+// A flood of more than max_cells is taken as anchored, which bounds the cost of a check; loose
+// pieces that large stay where they are.
+class IslandDetector {
+public:
+	static constexpr int max_cells = 1 << 14;
+
+private:
+	int width = 0;
+	int height = 0;
+	std::vector<uint64_t> visited;	// one bit per cell, cleared again at the end of check()
+	std::vector<uint64_t> anchored;
+	std::vector<uint32_t> stack;
+	std::vector<uint32_t> touched;	// cells visited by the current check, cell index y * width + x
+
+	static bool test(const std::vector<uint64_t>& bits, uint32_t i) { return (bits[i >> 6] >> (i & 63)) & 1; }
+	static void mark(std::vector<uint64_t>& bits, uint32_t i) { bits[i >> 6] |= 1ull << (i & 63); }
+	static void unmark(std::vector<uint64_t>& bits, uint32_t i) { bits[i >> 6] &= ~(1ull << (i & 63)); }
+
+	static bool is_structural(const Terrain& terrain, int x, int y) {
+		const MaterialProperties& m = terrain.material(x, y);
+		return m.solid && !m.granular;
+	}
+
+	// Floods the component of the structural cell i. Returns true if it is anchored; its cells are
+	// then marked anchored, otherwise they are left at the end of touched from first on.
+	bool flood(const Terrain& terrain, uint32_t i, size_t first) {
+		stack.clear();
+		stack.push_back(i);
+		mark(visited, i);
+		touched.push_back(i);
+		bool anchor = false;
+		while (!stack.empty() && !anchor) {
+			uint32_t c = stack.back();
+			stack.pop_back();
+			int x = c % width;
+			int y = c / width;
+			if (y == height - 1 || touched.size() - first > max_cells) {
+				anchor = true;
+				break;
+			}
+			// Pushed in reverse order of preference: down is popped first
+			const int dx[4] = { 0, -1, 1, 0 };
+			const int dy[4] = { -1, 0, 0, 1 };
+			for (int k = 0; k < 4; k++) {
+				int nx = x + dx[k], ny = y + dy[k];
+				if (!terrain.in_bounds(nx, ny)) continue;
+				uint32_t n = (uint32_t)(ny * width + nx);
+				if (test(visited, n)) {
+					if (test(anchored, n)) anchor = true;
+					continue;
+				}
+				if (!is_structural(terrain, nx, ny)) continue;
+				mark(visited, n);
+				touched.push_back(n);
+				stack.push_back(n);
+			}
+		}
+		if (anchor) {
+			for (size_t k = first; k < touched.size(); k++) mark(anchored, touched[k]);
+		}
+		return anchor;
+	}
+
+public:
+	void resize(int width, int height) {
+		this->width = width;
+		this->height = height;
+		visited.assign(((size_t)width * height + 63) / 64, 0);
+		anchored.assign(visited.size(), 0);
+	}
+
+	// Checks the structural cells within a cell of the inclusive rectangle. Every island found is
+	// turned into sand and reported through on_island(x0, y0, x1, y1), after the terrain has been
+	// refreshed over it. Returns the number of cells turned into sand.
+	template <class Fn>
+	int check(Terrain& terrain, int x0, int y0, int x1, int y1, Fn on_island) {
+		x0 = std::max(0, x0 - 1);
+		y0 = std::max(0, y0 - 1);
+		x1 = std::min(width - 1, x1 + 1);
+		y1 = std::min(height - 1, y1 + 1);
+		touched.clear();
+		int loosened = 0;
+		for (int y = y0; y <= y1; y++) {
+			for (int x = x0; x <= x1; x++) {
+				uint32_t i = (uint32_t)(y * width + x);
+				if (test(visited, i) || !is_structural(terrain, x, y)) continue;
+				size_t first = touched.size();
+				if (flood(terrain, i, first)) continue;
+
+				int ix0 = width, iy0 = height, ix1 = -1, iy1 = -1;
+				for (size_t k = first; k < touched.size(); k++) {
+					int cx = touched[k] % width;
+					int cy = touched[k] / width;
+					terrain.set(cx, cy, SAND);
+					ix0 = std::min(ix0, cx); ix1 = std::max(ix1, cx);
+					iy0 = std::min(iy0, cy); iy1 = std::max(iy1, cy);
+				}
+				loosened += (int)(touched.size() - first);
+				terrain.refresh(ix0, iy0, ix1, iy1);
+				on_island(ix0, iy0, ix1, iy1);
+			}
+		}
+		for (uint32_t i : touched) {
+			unmark(visited, i);
+			unmark(anchored, i);
+		}
+		return loosened;
+	}
+};
@@ -0,0 +1,138 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include <algorithm>
+#include "olcPixelGameEngine.h"
+#include "terrain.h"
+#include "raycast.h"
+#include "thread_pool.h"
+
+struct Light {
+	olc::vf2d pos;
+	float radius = 0;
+	olc::Pixel color = olc::WHITE;
+	float intensity = 1;
+};
+
+// Point lights occluded by the terrain, added onto the terrain render.
+//
+// Each light gets a 1D shadow map: the distance to the first solid cell along rays spread evenly
+// around it, one per bin, cast over the occupancy pyramid. A pixel is lit when it is no further
+// from the light than the map's depth in its direction. Bins are indexed by diamond angle, a
+// cheap monotonic stand-in for atan2.
+// Both passes run on the thread pool, the rays of all lights together and then bands of screen
+// rows. Composing touches each light's disc on screen only, so it costs at most the screen
+// area per light; the rays cost at most max_bins per light.
+class Lighting {
+public:
+	static constexpr int max_lights = 32;
+	static constexpr int min_bins = 64;
+	static constexpr int max_bins = 1024;
+
+private:
+	struct ShadowMap {
+		int bins = 0;
+		int first_ray = 0;	// index of bin 0 among all rays of the frame
+		std::array<float, max_bins> lit2;	// squared distance the bin is lit up to
+	};
+
+	std::array<Light, max_lights> lights;
+	std::array<ShadowMap, max_lights> maps;
+	int n_lights = 0;
+	int n_rays = 0;
+
+	// In [0, 4), counterclockwise from +x like atan2, but without the trigonometry
+	static float diamond_angle(float x, float y) {
+		if (y >= 0) return x >= 0 ? y / (x + y) : 1 - x / (y - x);
+		return x < 0 ? 2 - y / (-x - y) : 3 + x / (x - y);
+	}
+
+	static olc::vf2d diamond_dir(float a) {
+		if (a < 1) return { 1 - a, a };
+		if (a < 2) return { 1 - a, 2 - a };
+		if (a < 3) return { a - 3, 2 - a };
+		return { a - 3, a - 4 };
+	}
+
+	void cast_ray(const Terrain& terrain, int ray) {
+		int l = 0;
+		while (l + 1 < n_lights && maps[l + 1].first_ray <= ray) l++;
+		ShadowMap& map = maps[l];
+		int bin = ray - map.first_ray;
+		olc::vf2d dir = diamond_dir((bin + 0.5f) * 4 / map.bins);
+		RayHit hit = raycast(terrain, lights[l].pos, dir, lights[l].radius);
+		const float bias = 1.5f;	// lights the face of the cell a ray stops at
+		float lit = hit.hit ? std::min(hit.distance + bias, lights[l].radius) : lights[l].radius;
+		map.lit2[bin] = lit * lit;
+	}
+
+	// Adds light l to the rows y0..y1 of the target
+	void compose(olc::Sprite& target, const olc::vf2d& view_pos, float world_per_pixel, int l, int y0, int y1) const {
+		const Light& light = lights[l];
+		const ShadowMap& map = maps[l];
+		olc::vf2d center = (light.pos - view_pos) / world_per_pixel;
+		float r = light.radius / world_per_pixel;
+		y0 = std::max(y0, (int)(center.y - r));
+		y1 = std::min(y1, (int)(center.y + r) + 1);
+		const float bin_scale = map.bins / 4.0f;
+		const float r2 = light.radius * light.radius;
+		for (int y = y0; y <= y1; y++) {
+			olc::Pixel* row = target.GetData() + y * target.width;
+			float dy = (y + 0.5f) * world_per_pixel + view_pos.y - light.pos.y;
+			if (dy * dy >= r2) continue;
+			// Only the chord of the circle on this row
+			float half = std::sqrt(r2 - dy * dy) / world_per_pixel;
+			int x_lo = std::max(0, (int)(center.x - half));
+			int x_hi = std::min(target.width - 1, (int)(center.x + half) + 1);
+			for (int x = x_lo; x <= x_hi; x++) {
+				float dx = (x + 0.5f) * world_per_pixel + view_pos.x - light.pos.x;
+				float d2 = dx * dx + dy * dy;
+				if (d2 >= r2 || d2 == 0) continue;
+				int bin = std::min(map.bins - 1, (int)(diamond_angle(dx, dy) * bin_scale));
+				if (d2 > map.lit2[bin]) continue;
+				float falloff = 1 - std::sqrt(d2) / light.radius;
+				float k = falloff * falloff * light.intensity;
+				olc::Pixel& p = row[x];
+				p.r = (uint8_t)std::min(255.0f, p.r + light.color.r * k);
+				p.g = (uint8_t)std::min(255.0f, p.g + light.color.g * k);
+				p.b = (uint8_t)std::min(255.0f, p.b + light.color.b * k);
+			}
+		}
+	}
+
+public:
+	void clear() { n_lights = 0; }
+
+	// Lights beyond max_lights are ignored
+	void add(const Light& light) {
+		if (n_lights < max_lights && light.radius > 0) lights[n_lights++] = light;
+	}
+
+	int get_light_count() const { return n_lights; }
+
+	// Lights the target, which shows the map from view_pos on at world_per_pixel cells per pixel
+	void render(olc::Sprite& target, const Terrain& terrain, const olc::vf2d& view_pos, float world_per_pixel) {
+		if (n_lights == 0) return;
+
+		// About one bin per cell of circumference
+		n_rays = 0;
+		for (int l = 0; l < n_lights; l++) {
+			maps[l].bins = std::clamp((int)(lights[l].radius * 6.3f), min_bins, max_bins);
+			maps[l].first_ray = n_rays;
+			n_rays += maps[l].bins;
+		}
+		ThreadPool& pool = ThreadPool::shared();
+		pool.parallel_for(0, n_rays, 64, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) cast_ray(terrain, i);
+		});
+
+		const int band = 16;
+		pool.parallel_for(0, (target.height + band - 1) / band, 1, [&](int begin, int end) {
+			for (int b = begin; b < end; b++) {
+				int y0 = b * band;
+				int y1 = std::min(target.height, y0 + band) - 1;
+				for (int l = 0; l < n_lights; l++) compose(target, view_pos, world_per_pixel, l, y0, y1);
+			}
+		});
+	}
+};
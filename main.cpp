@@ -1,271 +1,107 @@
 
 #define OLC_PGE_APPLICATION
+#define ALLOC_TRACKER_APPLICATION
+#include "alloc_tracker.h"
 #include "olcPixelGameEngine.h"
-#include "perlin.h"
 #include "Random.h"
+#include "world.h"
+#include "trajectory.h"
+#include "ai.h"
+#include "atlas.h"
+#include "terrain_image.h"
+#include "minimap.h"
+#include "profiler.h"
+#include "terrain_bench.h"
+#include "batch_bench.h"
+#include "entity_bench.h"
+#include "nav_graph.h"
+#include "lighting.h"
 #include <memory>
+#include <future>
+#include <atomic>
 
-enum BounceDeathActions {
-	DO_NOTHING = 0,
-	EXPLOSION_LARGE
-};
-
-enum Phase {
-	RESET,
-	GENERATE_TERRAIN,
-	DEPLOY_TROOPS,
-	DEPLOYING_TROOPS,
-	START_PLAY,
-	CAMERA_MODE
-};
-
-class PhysicsObject {
-public:
-	olc::vf2d v;
-	olc::vf2d a;
-	olc::vf2d pos;
-	float friction = 0.8f;
-	float r;
-	int n_bounces = -1;
-	bool dead = false;
-	bool stable = false;
-
-	PhysicsObject(float r=10) : r(r) {}
-
-	virtual void draw(olc::PixelGameEngine& canvas, olc::vf2d& offset) {}
-	virtual int bounce_death_action() { return 0; }
-};
-
-class SpriteObject {
-public:
-	static std::unique_ptr<olc::Sprite> sprite;
-	static std::unique_ptr<olc::Decal> decal;
-
-	float scaleX = 1;
-	float scaleY = 1;
-
-	SpriteObject(float desired_height=10) {
-		set_size(desired_height);
-	}
-
-	static void init_sprite(const std::string& filename) {
-		sprite = std::make_unique<olc::Sprite>(filename);
-		decal = std::make_unique<olc::Decal>(sprite.get());
-	}
-
-	void set_size(float desired_height) {
-		if (sprite) {
-			// sprite->height*scale = desired_height
-			scaleX = desired_height / sprite->height;
-			scaleY = scaleX;
-		}
-	}
-
-	void set_size(float desired_width, float desired_height) {
-		if (sprite) {
-			// sprite->height*scale = desired_height
-			scaleX = desired_width / sprite->width;
-			scaleY = desired_height / sprite->height;
-		}
-	}
-};
-std::unique_ptr<olc::Sprite> SpriteObject::sprite = nullptr;
-std::unique_ptr<olc::Decal> SpriteObject::decal = nullptr;
-
-
-class Dummy : public PhysicsObject {
-public:
-	using PhysicsObject::PhysicsObject;
-
-	void draw(olc::PixelGameEngine& canvas, olc::vf2d& offset) override {
-		canvas.DrawCircle(pos+offset, r);
-		canvas.DrawLine(pos+offset, pos+offset + v.norm() * r);
-	}
-};
-
-class Debris : public PhysicsObject {
-public:
-	static std::unique_ptr<olc::Sprite> sprite;
-	static std::unique_ptr<olc::Decal> decal;
-	float scale = 1;
-	float default_size = 8;
-
-	Debris(int r = 4) : PhysicsObject(r) {
-		n_bounces = 3;
-	}
-
-	void draw(olc::PixelGameEngine& canvas, olc::vf2d& offset) override {
-		canvas.DrawRotatedDecal(pos+offset, decal.get(), atan2(v.y, v.x), {default_size*scale/2,default_size*scale/2}, {scale,scale}, olc::GREEN);
-	}
-
-	void set_size(float size) {
-		// default_size*x = size
-		scale = size / default_size;
-		r = size;
-	}
-
-	int bounce_death_action() {
-		dead = true;
-		return 0;
-	}
-};
-std::unique_ptr<olc::Sprite> Debris::sprite = nullptr;
-std::unique_ptr<olc::Decal> Debris::decal = nullptr;
-
-
-class Missile : public PhysicsObject {
-public:
-	static std::unique_ptr<olc::Sprite> sprite;
-	static std::unique_ptr<olc::Decal> decal;
-	float scale = 1;
-
-	Missile(float r = 10) : PhysicsObject(r) {
-		n_bounces = 0;
-		set_size(r);
-	}
-
-	void set_size(float radius) {
-		if (sprite) {
-			scale = radius / sprite->height;
-		}
-	}
-
-	void draw(olc::PixelGameEngine& canvas, olc::vf2d& offset) {
-		canvas.DrawRotatedDecal(pos + offset, decal.get(), atan2(v.y, v.x)-3.1415f/2, { sprite->width * scale / 2, sprite->height * scale / 2 }, { scale,scale });
-		//canvas.DrawDecal(pos + offset, decal.get(), { scale,scale });
-	}
-
-	int bounce_death_action() override {
-		dead = true;
-		return 1;
-	}
-};
-std::unique_ptr<olc::Sprite> Missile::sprite = nullptr;
-std::unique_ptr<olc::Decal> Missile::decal = nullptr;
-
-
-class Worm : public PhysicsObject, public SpriteObject {
-public:
-	int flip = 1;
-
-	Worm(float r=10) : PhysicsObject(r), SpriteObject(r) {
-		n_bounces = -1;
-		friction = 0.4;
-	}
-
-	void draw(olc::PixelGameEngine& canvas, olc::vf2d& offset) {
-		olc::vf2d draw_pos = pos + offset;
-		canvas.DrawCircle(draw_pos, r);
-
-		draw_pos.x -= r*flip;
-		draw_pos.y -= r;
-		//draw_pos.x -= sprite->width * scaleX / 2;
-		//draw_pos.y -= sprite->height * scaleY / 2;
-		
-		canvas.DrawDecal(draw_pos, decal.get(), { scaleX*flip,scaleY });
-	}
-
-	void set_r(float r) {
-		this->r = r;
-		set_size(r*2, r*2);
-	}
-
-};
-
+const std::string atlas_file = "sprites.atlas";
+const std::string trace_file = "trace.json";
+const std::vector<std::string> sprite_files = { "worm.png", "missile.png", "tut_fragment.png" };
 
 // Override base class with your custom functionality
 class Window : public olc::PixelGameEngine
 {
-	enum TerrainType {
-		SKY,
-		GROUND,
-	};
-
-	std::vector<std::vector<TerrainType>> terrain;
+	World world;
 	olc::vi2d terrain_size = { 800, 400 };
 
 	olc::vf2d camera;
-
-	std::list<std::unique_ptr<PhysicsObject>> objects;
+	// The view shows the map shrunk by 2^zoom, drawn from the matching level of terrain_image
+	int zoom = 0;
+	TerrainImage terrain_image;
+	olc::Sprite ground_texture = olc::Sprite(32, 32);
+	Minimap minimap;
+	bool show_minimap = true;
 
 	float aim_angle = 0;
 	const float aim_r = 8;
 	float shoot_strength = 0;
 	bool charging = false;
 	bool shot = false;
-	Worm* selected_player = nullptr;
-	PhysicsObject* followed_object = nullptr;
-
-	Phase game_state = RESET;
-
-
-	void boom(const olc::vf2d& expl_pos, float radius) {
-		auto CircleBresenham = [&](int xc, int yc, int r)
-			{
-				// Taken from wikipedia
-				int x = 0;
-				int y = r;
-				int p = 3 - 2 * r;
-				if (!r) return;
-
-				auto drawline = [&](int sx, int ex, int ny)
-					{
-						for (int i = sx; i < ex; i++)
-							if (ny >= 0 && ny < terrain_size.y && i >= 0 && i < terrain_size.x)
-								terrain[ny][i] = SKY;
-					};
-
-				while (y >= x)
-				{
-					// Modified to draw scan-lines instead of edges
-					drawline(xc - x, xc + x, yc - y);
-					drawline(xc - y, xc + y, yc - x);
-					drawline(xc - x, xc + x, yc + y);
-					drawline(xc - y, xc + y, yc + x);
-					if (p < 0) p += 4 * x++ + 6;
-					else p += 4 * (x++ - y--) + 10;
-				}
-			};
-
-		CircleBresenham(expl_pos.x, expl_pos.y, radius);
-
-		for (auto& obj : objects) {
-			olc::vf2d dir = obj->pos - expl_pos;
-			float div = powf(dir.mag(), 2);
-			if (div < 0.1) div = 0.1f;
-			dir /= div;
-			dir *= radius*radius;
-			obj->v = dir;
-			obj->stable = false;
-		}
-
-		for (int i = 0; i < radius*2; i++) {
-			std::unique_ptr<Debris> d = std::make_unique<Debris>();
-			d->pos = expl_pos;
-			d->v.x = random2() * radius*2;
-			d->v.y = random2() * radius*2;
-			d->set_size(2.5);
-			objects.push_back(std::move(d));
+	EntityHandle selected_player;
+	EntityHandle followed_object;
+	TrajectoryPredictor trajectory;
+	float physics_time = 0;
+	SpriteBatch sprites;
+	Atlas atlas;
+	std::future<void> atlas_loading;
+	std::future<void> terrain_loading;
+	std::atomic<int> loading_done{ 0 };
+	const int loading_total = 2;
+	float loading_time = 0;
+	bool show_render_stats = false;
+	int culled_objects = 0;	// skipped by the chunk query last frame
+	ShotPlanner ai_planner = ShotPlanner(AI_NORMAL);
+	uint32_t ai_seed = 0;
+	NavGraph nav;
+	bool show_nav = false;
+	Lighting lighting;
+	bool show_lighting = true;
+	std::vector<NavPathStep> nav_path;
+
+	float view_scale() const { return 1.0f / (1 << zoom); }
+	olc::vf2d view_size() { return olc::vf2d(GetScreenSize()) * (float)(1 << zoom); }
+	olc::vf2d to_world(const olc::vi2d& screen) { return olc::vf2d(screen) * (float)(1 << zoom) + camera; }
+	olc::vf2d to_screen(const olc::vf2d& world) const { return (world - camera) * view_scale(); }
+
+	// Steps the zoom level, keeping the map point under the mouse in place
+	void zoom_by(int steps) {
+		int max_zoom = 0;
+		while (max_zoom + 1 < terrain_image.get_levels() &&
+			((terrain_size.x >> max_zoom) > ScreenWidth() || (terrain_size.y >> max_zoom) > ScreenHeight())) {
+			max_zoom++;
 		}
+		olc::vf2d anchor = to_world(GetMousePos());
+		zoom = std::clamp(zoom + steps, 0, max_zoom);
+		camera = anchor - olc::vf2d(GetMousePos()) * (float)(1 << zoom);
 	}
 
-	void deploy_troop(const olc::vf2d& pos) {
-		std::unique_ptr<Worm> d = std::make_unique<Worm>();
-		d->set_r(6);
-		d->pos = pos;
-		selected_player = d.get();
-		objects.push_back(std::move(d));
-
+	void deploy_troop(const olc::vf2d& pos, int team) {
+		selected_player = world.deploy_troop(pos, team);
 	}
 
-	bool are_all_stable() {
-		for (auto& obj : objects) {
-			if (!obj->stable) {
-				//std::cout << obj->r << '\n';
-				return false;
-			}
+	// Lets the AI aim and charge for the selected worm. The shot is fired by the regular aiming code.
+	void ai_take_shot() {
+		std::vector<AiWorm> worms;
+		int shooter = -1;
+		std::vector<Worm>& all_worms = world.objects.all<Worm>();
+		for (size_t i = 0; i < all_worms.size(); i++) {
+			if (all_worms[i].dead) continue;
+			if (world.objects.handle_of<Worm>(i) == selected_player) shooter = (int)worms.size();
+			worms.push_back({ ProjectileState::from(all_worms[i]), all_worms[i].team });
+		}
+
+		AiShot ai_shot = ai_planner.plan(world.terrain, worms.data(), (int)worms.size(), shooter, ai_seed++);
+		if (ai_shot.found) {
+			aim_angle = ai_shot.angle;
+			shoot_strength = ai_shot.strength;
+			charging = false;
 		}
-		return true;
 	}
 
 	//void shoot_from_player() {
@@ -289,33 +125,65 @@ public:
 	bool OnUserCreate() override
 	{
 		// Called once at the start, so create things here
-		Debris::sprite = std::make_unique<olc::Sprite>("tut_fragment.png");
-		Debris::decal = std::make_unique<olc::Decal>(Debris::sprite.get());
-
-		Missile::sprite = std::make_unique<olc::Sprite>("missile.png");
-		Missile::decal = std::make_unique<olc::Decal>(Missile::sprite.get());
-
-		Worm::init_sprite("worm.png");
-
-		terrain = std::vector<std::vector<TerrainType>>(terrain_size.y, std::vector<TerrainType>(terrain_size.x, SKY));
-		Perlin1D perlin(terrain_size.x);
-		perlin.set_seed(0, 0.5);
-		for (int x = 0; x < terrain_size.x; x++) {
-			float v = perlin.get(x);
-			int h = v * terrain_size.y;
-			for (int y = h; y < terrain_size.y; y++) {
-				terrain[y][x] = GROUND;
-			}
+		// Decoding and terrain generation run in the background while LOADING shows progress
+		world.phase = LOADING;
+
+		// Ground is drawn from a tiled texture of mottled greens instead of a flat colour
+		std::mt19937 texture_rng(7);
+		std::uniform_int_distribution<int> shade(-24, 24);
+		for (int i = 0; i < ground_texture.width * ground_texture.height; i++) {
+			int d = shade(texture_rng);
+			ground_texture.GetData()[i] = olc::Pixel(40 + d / 2, 200 + d, 40 + d / 2);
 		}
+		Palette palette = terrain_image.get_palette();
+		palette.set_texture(DIRT, &ground_texture);
+		terrain_image.set_palette(palette);
+
+		atlas_loading = std::async(std::launch::async, [this] {
+			if (!atlas.load(atlas_file)) {
+				// No prebuilt atlas, pack the source images instead
+				atlas.pack(sprite_files);
+			}
+			loading_done++;
+		});
+		terrain_loading = std::async(std::launch::async, [this] {
+			world.generate_terrain(terrain_size.x, terrain_size.y);
+			loading_done++;
+		});
 		return true;
 	}
 
-	bool OnUserUpdate(float fElapsedTime) override
-	{
+	// Draws the progress screen until the background work is done, then uploads the atlas.
+	// Returns true once the game can start.
+	bool update_loading(float fElapsedTime) {
+		loading_time += fElapsedTime;
+		if (loading_done == loading_total) {
+			atlas_loading.get();
+			terrain_loading.get();
+
+			// GPU uploads have to happen on the render thread
+			atlas.create_decal();
+			Debris::sprite = atlas.get("tut_fragment.png");
+			Missile::sprite = atlas.get("missile.png");
+			Worm::init_sprite(atlas.get("worm.png"));
+			return true;
+		}
+
+		Clear(olc::BLACK);
+		int dots = (int)(loading_time * 3) % 4;
+		DrawString(ScreenWidth() / 2 - 32, ScreenHeight() / 2 - 12, "Loading" + std::string(dots, '.'));
+		FillRect(ScreenWidth() / 4, ScreenHeight() / 2, ScreenWidth() / 2, 4, olc::DARK_GREY);
+		FillRect(ScreenWidth() / 4, ScreenHeight() / 2, ScreenWidth() / 2 * loading_done / loading_total, 4, olc::GREEN);
+		return false;
+	}
+
+	void handle_input(float fElapsedTime) {
+		PROFILE_SCOPE(PROFILE_INPUT);
 		const int border = 50;
 		float scroll_speed = 100;
-		if (game_state == START_PLAY)
+		if (world.phase == START_PLAY)
 			scroll_speed = 400;
+		scroll_speed *= 1 << zoom;
 		if (GetMouseX() < border) {
 			//std::cout << "LEFT\n";
 			camera.x-=fElapsedTime*scroll_speed;
@@ -331,24 +199,24 @@ public:
 			camera.y+=scroll_speed*fElapsedTime;
 		}
 
+		if (GetMouseWheel() > 0) {
+			zoom_by(-1);
+		}
+		if (GetMouseWheel() < 0) {
+			zoom_by(1);
+		}
+
 		if (GetMouse(0).bPressed) {
-			std::unique_ptr<Worm> d = std::make_unique<Worm>();
-			d->set_r(6);
-			d->pos = GetMousePos() + camera;
-			selected_player = d.get();
+			deploy_troop(to_world(GetMousePos()), 0);
 			followed_object = selected_player;
-			objects.push_back(std::move(d));
 		}
 
 		if (GetMouse(1).bPressed) {
-			boom(GetMousePos() + camera, 10);
+			world.boom(to_world(GetMousePos()), 10);
 		}
 
 		if (GetKey(olc::N).bPressed) {
-			std::unique_ptr<Missile> m = std::make_unique<Missile>();
-			m->pos = GetMousePos() + camera;
-			objects.push_back(std::move(m));
-
+			world.spawn_missile(to_world(GetMousePos()), { 0, 0 });
 		}
 		if (GetKey(olc::A).bHeld) {
 			aim_angle -= fElapsedTime;
@@ -356,42 +224,64 @@ public:
 		if (GetKey(olc::D).bHeld) {
 			aim_angle += fElapsedTime;
 		}
+		Worm* player = world.objects.get<Worm>(selected_player);
 		if (GetKey(olc::SPACE).bPressed) {
-			const float force = 20;
-			if (selected_player && selected_player->stable) {
-				selected_player->v = olc::vf2d(cosf(aim_angle), sinf(aim_angle)) * force;
-				selected_player->stable = false;
+			if (player && player->stable) {
+				player->v = olc::vf2d(cosf(aim_angle), sinf(aim_angle)) * Worm::jump_force;
+				player->stable = false;
 			}
 		}
 		if (GetKey(olc::X).bPressed) {
 			charging = true;
 		}
+		if (GetKey(olc::P).bPressed && world.phase == START_PLAY && player && player->stable) {
+			ai_take_shot();
+		}
 		if (GetKey(olc::X).bReleased) {
 			charging = false;
 		}
+		if (GetKey(olc::F4).bPressed) {
+			Profiler::shared().set_enabled(!Profiler::shared().is_enabled());
+		}
+		if (GetKey(olc::F5).bPressed && Profiler::shared().is_enabled()) {
+			Profiler::shared().dump_csv("profile.csv");
+			Profiler::shared().dump_json("profile.json");
+		}
+		// First press starts tracing, later ones save what the trace buffers hold
+		if (GetKey(olc::F6).bPressed) {
+			if (Tracer::shared().is_enabled()) Tracer::shared().write_chrome_json(trace_file);
+			else Tracer::shared().set_enabled(true);
+		}
 
-		if (followed_object) {
-			camera += (followed_object->pos - (camera + GetScreenSize() / 2)) * fElapsedTime * 5.0f;
+		if (PhysicsObject* followed = world.objects.get_base<PhysicsObject>(followed_object)) {
+			camera += (followed->pos - (camera + view_size() / 2)) * fElapsedTime * 5.0f;
 		}
 
-		camera.x = std::max(0.0f, std::min((float)terrain_size.x - ScreenWidth(), camera.x));
-		camera.y = std::max(0.0f, std::min((float)terrain_size.y - ScreenWidth(), camera.y));
+		camera.x = std::max(0.0f, std::min((float)terrain_size.x - view_size().x, camera.x));
+		camera.y = std::max(0.0f, std::min((float)terrain_size.y - view_size().y, camera.y));
 		//std::cout << camera.str() << '\n';
+	}
+
+	void update_phase() {
+		PROFILE_SCOPE(PROFILE_STATE);
+		Phase next_game_state = world.phase;
+		switch (world.phase) {
+		case LOADING:	// handled by update_loading() before the game loop runs
+			break;
 
-		Phase next_game_state = game_state;
-		switch (game_state) {
 		case RESET:
 			next_game_state = DEPLOY_TROOPS;
 			break;
 
 		case DEPLOY_TROOPS:
-			deploy_troop(olc::vf2d(200, 20));
-			deploy_troop(olc::vf2d(100, 20));
+			// Just above the ground, so they land without a long fall
+			deploy_troop(olc::vf2d(200, world.terrain.get_surface().get(200) - 8.0f), 1);
+			deploy_troop(olc::vf2d(100, world.terrain.get_surface().get(100) - 8.0f), 0);
 			next_game_state = DEPLOYING_TROOPS;
 			break;
 
 		case DEPLOYING_TROOPS:
-			if (are_all_stable()) {
+			if (world.are_all_stable()) {
 				next_game_state = START_PLAY;
 			}
 			else {
@@ -411,8 +301,8 @@ public:
 			break;
 
 		case CAMERA_MODE:
-			if (are_all_stable()) {
-				followed_object = nullptr;
+			if (world.are_all_stable()) {
+				followed_object = EntityHandle();
 				next_game_state = START_PLAY;
 			}
 			else {
@@ -420,135 +310,232 @@ public:
 			}
 			break;
 		}
-		game_state = next_game_state;
-
-		// PHYSIX SHIT
-
-		for (int i = 0; i < 5; i++) {
-			for (auto& obj : objects) {
-				if (obj->stable) continue;
-
-				obj->a += olc::vf2d(0, 10);
-				obj->v += obj->a * fElapsedTime;
-
-				olc::vf2d potential_pos = obj->pos + obj->v * fElapsedTime;
-				float v_angle = std::atan2(obj->v.y, obj->v.x);
-				olc::vf2d vec_response = { 0,0 };
-				bool b_collision = false;
-				for (float a = v_angle - 3.1415f / 2; a < v_angle + 3.1415f / 2; a += 3.1415f / 8) {
-					olc::vf2d vec_mv = { cosf(a) * obj->r, sinf(a) * obj->r };
-					olc::vf2d test_pos = potential_pos + vec_mv;
+		if (next_game_state != world.phase) {
+			TRACE_INSTANT(phase_name(next_game_state));
+		}
+		world.phase = next_game_state;
+	}
 
-					if (test_pos.x < 0 || test_pos.x > terrain_size.x || test_pos.y < 0 || test_pos.y > terrain_size.y) {
-						obj->dead = true;
-						continue;
-					}
+	void draw_terrain() {
+		PROFILE_SCOPE(PROFILE_TERRAIN_DRAW);
+		NO_ALLOC_SCOPE();
+		// One texel per screen pixel from the mip level matching the zoom, whatever the zoom
+		terrain_image.update(world.terrain);
+		int cam_x = camera.x;
+		int cam_y = camera.y;
+		terrain_image.blit(*GetDrawTarget(), world.terrain, zoom, cam_x >> zoom, cam_y >> zoom);
+	}
 
-					if (terrain[(int)test_pos.y][(int)test_pos.x] == GROUND) {
-						b_collision = true;
-						vec_response += vec_mv;
-					}
-				}
+	// Explosions flash and missiles glow, both shadowed by the terrain
+	void draw_lighting() {
+		PROFILE_SCOPE(PROFILE_LIGHTING);
+		lighting.clear();
+		if (!show_lighting) return;
+		for (const Explosion& e : world.explosions) {
+			float fade = 1 - e.age / World::explosion_lifetime;
+			lighting.add({ e.pos, e.radius * 6, olc::Pixel(255, 170, 60), fade * fade });
+		}
+		for (const Missile& m : world.objects.all<Missile>()) {
+			lighting.add({ m.pos, 40, olc::Pixel(255, 220, 150), 0.5f });
+		}
+		lighting.render(*GetDrawTarget(), world.terrain, olc::vf2d((float)((int)camera.x >> zoom << zoom), (float)((int)camera.y >> zoom << zoom)), (float)(1 << zoom));
+	}
 
-				if (b_collision) {
-					vec_response *= -1;
-					vec_response = vec_response.norm();
-					obj->v = obj->v - 2 * (obj->v.dot(vec_response)) * vec_response;
-					obj->v *= obj->friction;
-					if (obj->v.mag() < 1.0f) {
-						obj->stable = true;
-						obj->v.x = 0;
-						obj->v.y = 0;
-					}
-
-					if (obj->n_bounces > 0) {
-						obj->n_bounces--;
-					}
-					else if (obj->n_bounces == 0) {
-						int action = obj->bounce_death_action();
-						if (action == BounceDeathActions::EXPLOSION_LARGE) {
-							boom(obj->pos, 20);
-						}
-						obj->n_bounces--;
-						if (obj->dead && obj.get() == followed_object) {
-							followed_object = nullptr;
-						}
-					}
-				}
-				else {
-					obj->pos = potential_pos;
-				}
+	void draw_objects() {
+		PROFILE_SCOPE(PROFILE_OBJECT_DRAW);
+		// Only objects filed under chunks overlapping the view, padded by the largest sprite, are drawn
+		const int cull_margin = 16;
+		int cam_x = camera.x;
+		int cam_y = camera.y;
+		olc::vf2d offset = camera * -1;
+		olc::vi2d view_end = olc::vi2d(camera + view_size());
+		world.update_chunks();
+		sprites.begin(*this, view_scale());
+		culled_objects = 0;
+		world.objects.for_each_kind([&](auto& items) {
+			using T = typename std::decay_t<decltype(items)>::value_type;
+			int visited = 0;
+			world.chunks.query(ObjectStore::kind_of<T>(), cam_x - cull_margin, cam_y - cull_margin,
+				view_end.x + cull_margin, view_end.y + cull_margin, [&](uint32_t i) {
+				items[i].draw(sprites, offset);
+				visited++;
+			});
+			culled_objects += (int)items.size() - visited;
+		});
+		sprites.flush();
+	}
 
-				obj->a = olc::vf2d(0, 0);
+	// Walkable ground, jump landings and the route from the selected worm to the mouse
+	void draw_nav() {
+		const SurfaceCache& surface = world.terrain.get_surface();
+		for (int id = 0; id < nav.get_node_count(); id++) {
+			const NavNode& n = nav.get_node(id);
+			if (!n.alive) continue;
+			DrawLine(to_screen(olc::vf2d((float)n.x0, (float)surface.get(n.x0))), to_screen(olc::vf2d(n.x1 + 1.0f, (float)surface.get(n.x1))), olc::CYAN);
+			for (const NavLink& l : n.links) {
+				if (l.type == NAV_JUMP) DrawLine(to_screen(l.start), to_screen(l.end), olc::DARK_CYAN);
 			}
 		}
+		Worm* player = world.objects.get<Worm>(selected_player);
+		if (!player) return;
+		olc::vf2d target = to_world(GetMousePos());
+		if (!nav.find_path(nav.node_at(player->pos), nav.node_at(target), nav_path)) return;
+		olc::vf2d from = player->pos;
+		for (const NavPathStep& step : nav_path) {
+			if (step.link < 0) break;
+			const NavLink& l = nav.get_node(step.node).links[step.link];
+			DrawLine(to_screen(from), to_screen(l.start), olc::YELLOW);
+			DrawLine(to_screen(l.start), to_screen(l.end), olc::YELLOW);
+			from = l.end;
+		}
+		DrawLine(to_screen(from), to_screen(nav.get_node(nav_path.back().node).pos), olc::YELLOW);
+	}
 
-		// DRAWING
-
-		for (int x = 0; x < ScreenWidth(); x++) {
-			for (int y = 0; y<ScreenHeight(); y++) {
-				switch (terrain[y+camera.y][x+camera.x]) {
-				case SKY:
-					Draw(x, y, olc::BLUE);
-					break;
-				case GROUND:
-					Draw(x, y, olc::GREEN);
-					break;
-				}
-			}
+	void draw_overlay(float fElapsedTime) {
+		PROFILE_SCOPE(PROFILE_OVERLAY);
+		if (GetKey(olc::M).bPressed) {
+			show_minimap = !show_minimap;
+		}
+		if (show_minimap) {
+			minimap.draw(*this, terrain_image, world, camera, view_size());
 		}
 
-			
-		objects.remove_if([](auto& el) {return el->dead; });
+		if (GetKey(olc::F3).bPressed) {
+			show_render_stats = !show_render_stats;
+		}
+		if (show_render_stats) {
+			DrawString(2, 2, "drawn  " + std::to_string(sprites.get_drawn()));
+			DrawString(2, 12, "culled " + std::to_string(culled_objects));
+			DrawString(2, 22, "sand   " + std::to_string(world.sand.get_active_chunks()));
+			DrawString(2, 32, "water  " + std::to_string(world.water.get_queued()));
+		}
 
-		olc::vf2d offset = camera * -1;
-		for (auto& obj : objects) {
-			obj->draw(*this, offset);
+		if (GetKey(olc::F7).bPressed) {
+			show_nav = !show_nav;
+		}
+		if (GetKey(olc::L).bPressed) {
+			show_lighting = !show_lighting;
+		}
+		if (show_nav) {
+			draw_nav();
 		}
 
 
-		if (selected_player && game_state == START_PLAY) {
+		Worm* player = world.objects.get<Worm>(selected_player);
+		if (player && world.phase == START_PLAY) {
 			auto dir = olc::vf2d(cosf(aim_angle), sinf(aim_angle));
 			auto dir_l = olc::vf2d(cosf(3.1415 + aim_angle + 1), sinf(3.1415 + aim_angle + 1));
 			auto dir_r = olc::vf2d(cosf(3.1415 + aim_angle - 1), sinf(3.1415 + aim_angle - 1));
-			olc::vf2d arrow_start = selected_player->pos + dir*aim_r - camera;
-			auto arrow_end = arrow_start + dir * 8;
-			DrawLine(arrow_start,arrow_end);
-			DrawLine(arrow_end + dir_l*3, arrow_end);
-			DrawLine(arrow_end + dir_r*3, arrow_end);
+			auto arrow_end = player->pos + dir * Missile::muzzle_offset;
+			olc::vf2d arrow_start = player->pos + dir*aim_r;
+			DrawLine(to_screen(arrow_start), to_screen(arrow_end));
+			DrawLine(to_screen(arrow_end + dir_l*3), to_screen(arrow_end));
+			DrawLine(to_screen(arrow_end + dir_r*3), to_screen(arrow_end));
 
 			if (charging) {
 				shoot_strength += fElapsedTime;
-				FillRect(selected_player->pos + olc::vf2d(-selected_player->r, selected_player->r) - camera, olc::vf2d(selected_player->r*2, 3), olc::RED);
-				FillRect(selected_player->pos + olc::vf2d(-selected_player->r, selected_player->r) - camera, olc::vf2d(selected_player->r * 2 * shoot_strength, 3), olc::DARK_GREEN);
+				olc::vf2d bar_pos = to_screen(player->pos + olc::vf2d(-player->r, player->r));
+				FillRect(bar_pos, olc::vf2d(player->r*2, 3) * view_scale(), olc::RED);
+				FillRect(bar_pos, olc::vf2d(player->r * 2 * shoot_strength, 3) * view_scale(), olc::DARK_GREEN);
 				if (shoot_strength >= 1) {
 					shoot_strength = 1;
 					charging = false;
 				}
+
+				Missile preview;
+				preview.pos = arrow_end;
+				preview.v = dir * shoot_strength * Missile::launch_speed;
+				trajectory.predict(world.terrain, ProjectileState::from(preview));
+				for (int i = 0; i < trajectory.get_point_count(); i += 2) {
+					Draw(to_screen(trajectory.get_point(i)), olc::WHITE);
+				}
+				if (trajectory.has_impact()) {
+					DrawCircle(to_screen(trajectory.get_impact()), World::explosion_radius * view_scale(), olc::RED);
+				}
 			}
 			else if (shoot_strength > 0) {
-				if (selected_player) {
-					std::unique_ptr<Missile> m = std::make_unique<Missile>();
-					m->pos = arrow_end + camera;
-					m->v = dir * shoot_strength * 60;
-					followed_object = m.get();
-					objects.push_back(std::move(m));
+				if (player) {
+					followed_object = world.spawn_missile(arrow_end, dir * shoot_strength * Missile::launch_speed);
 					shot = true;
-					
 				}
 				shoot_strength = 0;
 			}
 		}
-		
-		
+	}
+
+	bool OnUserUpdate(float fElapsedTime) override
+	{
+		if (world.phase == LOADING) {
+			if (update_loading(fElapsedTime)) {
+				world.phase = RESET;
+			}
+			return true;
+		}
+
+		Profiler& profiler = Profiler::shared();
+		profiler.begin_frame();
+		{
+			PROFILE_SCOPE(PROFILE_FRAME);
+			handle_input(fElapsedTime);
+			update_phase();
+			{
+				PROFILE_SCOPE(PROFILE_PHYSICS);
+				physics_time = std::min(physics_time + fElapsedTime, World::step_dt * World::max_steps_per_frame);
+				while (physics_time >= World::step_dt) {
+					world.step(World::step_dt);
+					physics_time -= World::step_dt;
+				}
+				world.remove_dead();
+			}
+			// Repaired once a blast has settled rather than on every frame of a collapse
+			if (world.sand.get_active_chunks() == 0 && world.water.get_queued() == 0 && world.are_all_stable()) {
+				nav.update(world.terrain);
+			}
+			draw_terrain();
+			draw_lighting();
+			draw_objects();
+			draw_overlay(fElapsedTime);
+		}
+		profiler.end_frame();
+		if (profiler.is_enabled()) {
+			profiler.draw(*this, 2, 44);
+		}
 		return true;
 	}
 };
 
-int main()
+int main(int argc, char* argv[])
 {
 	Window win;
+	if (argc > 1 && std::string(argv[1]) == "--build-atlas") {
+		// Asset build step, run after every build: pack all sprites into one file for a fast startup
+		Atlas atlas;
+		bool ok = atlas.pack(sprite_files) && atlas.save(atlas_file);
+		std::cout << (ok ? "Packed " : "Failed to pack ") << atlas_file << '\n';
+		return ok ? 0 : 1;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--bench-terrain") {
+		run_terrain_benchmark(std::cout);
+		return 0;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--check-trace") {
+		return check_trace_timestamps(std::cout) ? 0 : 1;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--bench-entities") {
+		run_entity_benchmark(std::cout);
+		return 0;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--bench-batch") {
+		run_batch_benchmark(std::cout);
+		return 0;
+	}
+	// --trace records from the first frame and saves trace.json on exit
+	bool trace = argc > 1 && std::string(argv[1]) == "--trace";
+	Tracer::shared().set_enabled(trace);
 	if (win.Construct(256, 256, 3, 3))
 		win.Start();
+	if (trace) {
+		Tracer::shared().write_chrome_json(trace_file);
+	}
 	return 0;
 }
\ No newline at end of file
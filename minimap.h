@@ -0,0 +1,57 @@
+#pragma once
+#include <cstring>
+#include <algorithm>
+#include "olcPixelGameEngine.h"
+#include "terrain_image.h"
+#include "world.h"
+
+// Overview of the whole map in a screen corner.
+// The terrain comes straight from the first TerrainImage level that fits, which is kept up to
+// date tile by tile as explosions land, so a frame only copies a few thousand pixels and plots
+// one marker per worm and missile.
+class Minimap {
+	int max_width;
+	int max_height;
+
+public:
+	Minimap(int max_width = 128, int max_height = 64) : max_width(max_width), max_height(max_height) {}
+
+	// Level 0 is not stored, so even a map that would fit uses level 1
+	int level_for(const TerrainImage& image) const {
+		int level = 1;
+		while (level + 1 < image.get_levels() &&
+			(image.get_width(level) > max_width || image.get_height(level) > max_height)) {
+			level++;
+		}
+		return level;
+	}
+
+	// Draws at the top right corner of the canvas; view_pos and view_size are the camera rectangle in map cells
+	void draw(olc::PixelGameEngine& canvas, const TerrainImage& image, World& world, const olc::vf2d& view_pos, const olc::vf2d& view_size) const {
+		if (image.get_levels() < 2) return;
+		int level = level_for(image);
+		int w = image.get_width(level);
+		int h = image.get_height(level);
+		int x0 = canvas.ScreenWidth() - w - 2;
+		int y0 = 2;
+
+		olc::Sprite& target = *canvas.GetDrawTarget();
+		int rows = std::min(h, target.height - y0);
+		if (x0 < 0 || rows <= 0) return;
+		for (int y = 0; y < rows; y++) {
+			memcpy(target.GetData() + (y0 + y) * target.width + x0, image.get_row(level, y), w * sizeof(olc::Pixel));
+		}
+		canvas.DrawRect(x0 - 1, y0 - 1, w + 1, h + 1, olc::BLACK);
+
+		float scale = 1.0f / (1 << level);
+		auto to_map = [&](const olc::vf2d& p) { return olc::vi2d(x0 + (int)(p.x * scale), y0 + (int)(p.y * scale)); };
+		canvas.DrawRect(to_map(view_pos), olc::vi2d(view_size * scale), olc::WHITE);
+		for (const Missile& m : world.objects.all<Missile>()) {
+			canvas.Draw(to_map(m.pos), olc::YELLOW);
+		}
+		for (const Worm& worm : world.objects.all<Worm>()) {
+			olc::vi2d p = to_map(worm.pos);
+			canvas.FillRect(p.x - 1, p.y - 1, 3, 3, worm.team == 0 ? olc::RED : olc::MAGENTA);
+		}
+	}
+};
@@ -0,0 +1,369 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "olcPixelGameEngine.h"
+#include "terrain.h"
+#include "physics.h"
+#include "trajectory.h"
+#include "world.h"
+#include "thread_pool.h"
+
+enum NavLinkType : uint8_t {
+	NAV_WALK,	// along the ground, or off a ledge and down
+	NAV_JUMP
+};
+
+struct NavLink {
+	int to = -1;
+	NavLinkType type = NAV_WALK;
+	olc::vf2d start;	// where the worm stands to take the link
+	float angle = 0;	// of the jump or of the step off a ledge, 0 is right
+	olc::vf2d end;	// where the physics brought it to rest
+	float cost = 0;
+};
+
+// A run of neighbouring surface columns a worm can walk along
+struct NavNode {
+	int x0 = 0;	// inclusive columns
+	int x1 = -1;
+	olc::vf2d pos;	// standing over the middle column
+	bool alive = false;
+	std::vector<NavLink> links;
+};
+
+struct NavPathStep {
+	int node;
+	int link;	// taken from node, -1 on the last step
+};
+
+// Walk and jump graph over the terrain surface for worm pathfinding.
+//
+// Nodes are runs of up to max_node_width surface columns without steps higher than max_step and
+// with air above, so the lake floor is not walkable. Links leave a node at its ends and from sampled columns
+// in between. Every jump (at Worm::jump_force) and every step off a ledge is flown through the
+// real integrator, and a link is kept only if the worm comes to rest on another node, one per
+// target.
+// update() only rebuilds where the surface height changed since. The nodes there are segmented
+// again, and the links of all nodes within reach columns are revalidated on the thread pool.
+// find_path() is A* over node ids with reused scratch arrays.
+class NavGraph {
+public:
+	static constexpr int max_step = 3;
+	static constexpr int max_node_width = 32;
+	static constexpr int reach = 96;	// further than any jump flies and rolls
+	static constexpr int sample_spacing = 16;
+	static constexpr float jump_penalty = 8;	// extra cost of a jump over walking the same distance
+
+private:
+	float worm_r;
+	float worm_friction;
+	float worm_buoyancy;
+	float jump_force;
+
+	int width = 0;
+	int height = 0;
+	bool built = false;
+	unsigned revision = 0;
+	std::vector<int> heights;	// surface the nodes were built from
+	std::vector<int> column_node;	// node standing on each column, -1 if none
+	std::vector<NavNode> nodes;
+	std::vector<int> free_nodes;
+	std::vector<uint8_t> dirty_columns;
+	std::vector<std::pair<int, int>> repaired;	// column ranges segmented again by the current update
+	std::vector<int> relink_nodes;
+	int links_checked = 0;
+
+	// A* scratch, reset lazily through the search stamp
+	std::vector<float> cost_to;
+	std::vector<NavPathStep> came_from;
+	std::vector<uint32_t> stamp;
+	std::vector<std::pair<float, int>> open;
+	uint32_t search = 0;
+
+	olc::vf2d stand_pos(int x) const {
+		return { x + 0.5f, heights[x] - worm_r - 0.5f };
+	}
+
+	bool walkable(const Terrain& terrain, int x) const {
+		int h = heights[x];
+		return h < height && h - 2 * worm_r >= 0 && terrain.density(x, h - 1) == 0;
+	}
+
+	int add_node(int x0) {
+		int id;
+		if (free_nodes.empty()) {
+			id = (int)nodes.size();
+			nodes.emplace_back();
+		}
+		else {
+			id = free_nodes.back();
+			free_nodes.pop_back();
+		}
+		NavNode& n = nodes[id];
+		n.x0 = x0;
+		n.x1 = x0;
+		n.alive = true;
+		n.links.clear();
+		return id;
+	}
+
+	void remove_node(int id) {
+		NavNode& n = nodes[id];
+		for (int x = n.x0; x <= n.x1; x++) column_node[x] = -1;
+		n.alive = false;
+		n.links.clear();
+		free_nodes.push_back(id);
+	}
+
+	// Splits the columns x0..x1, which belong to no node, into new nodes
+	void segment(const Terrain& terrain, int x0, int x1) {
+		int current = -1;
+		for (int x = x0; x <= x1; x++) {
+			if (!walkable(terrain, x)) {
+				current = -1;
+				continue;
+			}
+			if (current >= 0 && std::abs(heights[x] - heights[x - 1]) <= max_step && x - nodes[current].x0 < max_node_width) nodes[current].x1 = x;
+			else current = add_node(x);
+			column_node[x] = current;
+		}
+		for (int x = x0; x <= x1; x++) {
+			int id = column_node[x];
+			if (id >= 0 && nodes[id].x0 == x) nodes[id].pos = stand_pos((nodes[id].x0 + nodes[id].x1) / 2);
+		}
+	}
+
+	// Node the worm rests on at pos, or -1 if it is not standing on one
+	int resting_node(const olc::vf2d& pos) const {
+		int x = (int)pos.x;
+		if (x < 0 || x >= width) return -1;
+		int id = column_node[x];
+		if (id < 0 || std::abs(pos.y + worm_r - heights[x]) > worm_r) return -1;
+		return id;
+	}
+
+	// Flies a worm through the integrator, stepped like World::step(), until it comes to rest. Returns false if it never does or dies.
+	bool fly(const Terrain& terrain, const olc::vf2d& start, const olc::vf2d& v, olc::vf2d& end) const {
+		const int max_frames = 240;
+		ProjectileState s;
+		s.pos = start;
+		s.v = v;
+		s.r = worm_r;
+		s.friction = worm_friction;
+		s.buoyancy = worm_buoyancy;
+		for (int frame = 0; frame < max_frames && !s.stable && !s.dead; frame++) {
+			for (int i = 0; i < World::substeps && !s.stable && !s.dead; i++) integrate(s, terrain, World::step_dt);
+		}
+		end = s.pos;
+		return s.stable && !s.dead;
+	}
+
+	// Keeps the cheapest link to each target
+	static void add_link(NavNode& n, const NavLink& link) {
+		for (NavLink& l : n.links) {
+			if (l.to == link.to) {
+				if (link.cost < l.cost) l = link;
+				return;
+			}
+		}
+		n.links.push_back(link);
+	}
+
+	void link_node(const Terrain& terrain, int id) {
+		NavNode& n = nodes[id];
+		n.links.clear();
+
+		// Off either end: a plain step to a neighbour at about the same height, otherwise a walk off the ledge
+		for (int side = -1; side <= 1; side += 2) {
+			int edge = side < 0 ? n.x0 : n.x1;
+			int next = edge + side;
+			if (next < 0 || next >= width) continue;
+			NavLink link;
+			link.type = NAV_WALK;
+			link.start = stand_pos(edge);
+			link.angle = side < 0 ? 3.1415f : 0.0f;
+			int neighbour = column_node[next];
+			if (neighbour >= 0 && std::abs(heights[next] - heights[edge]) <= max_step) {
+				link.to = neighbour;
+				link.end = stand_pos(next);
+			}
+			else if (neighbour < 0 || heights[next] > heights[edge]) {
+				if (!fly(terrain, link.start, { side * 4.0f, 0.0f }, link.end)) continue;
+				link.to = resting_node(link.end);
+				if (link.to < 0 || link.to == id) continue;
+			}
+			else {
+				continue;
+			}
+			link.cost = (n.pos - link.start).mag() + (link.start - link.end).mag() + (link.end - nodes[link.to].pos).mag();
+			add_link(n, link);
+		}
+
+		// Jumps both ways at four elevations from the ends and every sample_spacing columns
+		const float elevations[] = { 0.35f, 0.7f, 1.05f, 1.4f };
+		for (int x = n.x0; x <= n.x1; x = (x == n.x1 ? x + 1 : std::min(n.x1, x + sample_spacing))) {
+			for (float elevation : elevations) {
+				for (float angle : { -elevation, -(3.1415f - elevation) }) {
+					NavLink link;
+					link.type = NAV_JUMP;
+					link.start = stand_pos(x);
+					link.angle = angle;
+					if (!fly(terrain, link.start, olc::vf2d(cosf(angle), sinf(angle)) * jump_force, link.end)) continue;
+					link.to = resting_node(link.end);
+					if (link.to < 0 || link.to == id) continue;
+					link.cost = (n.pos - link.start).mag() + (link.start - link.end).mag() * 1.5f + jump_penalty +
+						(link.end - nodes[link.to].pos).mag();
+					add_link(n, link);
+				}
+			}
+		}
+	}
+
+	// Revalidates the links of the nodes in relink_nodes in parallel, and drops links to removed nodes elsewhere
+	void relink(const Terrain& terrain) {
+		ThreadPool::shared().parallel_for(0, (int)relink_nodes.size(), 1, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) link_node(terrain, relink_nodes[i]);
+		});
+		links_checked = (int)relink_nodes.size();
+		for (NavNode& n : nodes) {
+			if (!n.alive) continue;
+			n.links.erase(std::remove_if(n.links.begin(), n.links.end(), [&](const NavLink& l) { return !nodes[l.to].alive; }), n.links.end());
+		}
+	}
+
+public:
+	NavGraph(float worm_r = Worm::troop_r, float worm_friction = Worm::worm_friction, float worm_buoyancy = Worm::worm_buoyancy,
+		float jump_force = Worm::jump_force)
+		: worm_r(worm_r), worm_friction(worm_friction), worm_buoyancy(worm_buoyancy), jump_force(jump_force) {}
+
+	void build(const Terrain& terrain) {
+		width = terrain.get_width();
+		height = terrain.get_height();
+		heights.resize(width);
+		for (int x = 0; x < width; x++) heights[x] = terrain.get_surface().get(x);
+		column_node.assign(width, -1);
+		dirty_columns.assign(width, 0);
+		nodes.clear();
+		free_nodes.clear();
+		segment(terrain, 0, width - 1);
+		relink_nodes.clear();
+		for (int id = 0; id < (int)nodes.size(); id++) relink_nodes.push_back(id);
+		relink(terrain);
+		revision = terrain.get_revision();
+		built = true;
+	}
+
+	// Catches up with the terrain edits since the last build or update
+	void update(const Terrain& terrain) {
+		if (!built || width != terrain.get_width() || height != terrain.get_height()) {
+			build(terrain);
+			return;
+		}
+		if (terrain.get_revision() == revision) return;
+		revision = terrain.get_revision();
+
+		// Comparing every column is a few microseconds, and unlike the edit log never overflows
+		// while sand and water keep the terrain busy
+		const SurfaceCache& surface = terrain.get_surface();
+		bool any = false;
+		for (int x = 0; x < width; x++) {
+			dirty_columns[x] = surface.get(x) != heights[x];
+			any |= dirty_columns[x] != 0;
+		}
+		if (!any) return;
+
+		// Resegments each dirty run together with the nodes it touches
+		repaired.clear();
+		for (int x = 0; x < width; x++) {
+			if (!dirty_columns[x]) continue;
+			int a = x, b = x;
+			while (b + 1 < width && dirty_columns[b + 1]) b++;
+			for (int c = a; c <= b; c++) dirty_columns[c] = 0;
+			int lo = std::max(0, a - 1), hi = std::min(width - 1, b + 1);
+			for (int c = lo; c <= hi; c++) {
+				int id = column_node[c];
+				if (id < 0) continue;
+				a = std::min(a, nodes[id].x0);
+				b = std::max(b, nodes[id].x1);
+				remove_node(id);
+			}
+			for (int c = a; c <= b; c++) heights[c] = surface.get(c);
+			segment(terrain, a, b);
+			repaired.push_back({ a, b });
+			x = b;
+		}
+		relink_nodes.clear();
+		for (int id = 0; id < (int)nodes.size(); id++) {
+			const NavNode& n = nodes[id];
+			if (!n.alive) continue;
+			for (auto [a, b] : repaired) {
+				if (n.x1 >= a - reach && n.x0 <= b + reach) {
+					relink_nodes.push_back(id);
+					break;
+				}
+			}
+		}
+		relink(terrain);
+	}
+
+	int get_node_count() const { return (int)nodes.size(); }
+	const NavNode& get_node(int id) const { return nodes[id]; }
+	int get_links_checked() const { return links_checked; }	// nodes relinked by the last build or update
+
+	// Node under a standing or nearby worm, -1 if it is not over one
+	int node_at(const olc::vf2d& pos) const {
+		int x = (int)pos.x;
+		if (x < 0 || x >= width) return -1;
+		int id = column_node[x];
+		if (id < 0 || std::abs(pos.y + worm_r - heights[x]) > 3 * worm_r) return -1;
+		return id;
+	}
+
+	// Cheapest route from node from to node to, as the nodes passed and the link taken from each.
+	// Returns false, with path empty, if to cannot be reached.
+	bool find_path(int from, int to, std::vector<NavPathStep>& path) {
+		path.clear();
+		if (from < 0 || to < 0 || !nodes[from].alive || !nodes[to].alive) return false;
+		if (stamp.size() < nodes.size()) {
+			cost_to.resize(nodes.size());
+			came_from.resize(nodes.size());
+			stamp.resize(nodes.size(), 0);
+		}
+		search++;
+		auto heuristic = [&](int id) { return (nodes[id].pos - nodes[to].pos).mag(); };
+		auto later = [](const std::pair<float, int>& a, const std::pair<float, int>& b) { return a.first > b.first; };
+		open.clear();
+		stamp[from] = search;
+		cost_to[from] = 0;
+		came_from[from] = { -1, -1 };
+		open.push_back({ heuristic(from), from });
+		while (!open.empty()) {
+			std::pop_heap(open.begin(), open.end(), later);
+			auto [f, id] = open.back();
+			open.pop_back();
+			if (id == to) break;
+			if (f > cost_to[id] + heuristic(id) + 1e-3f) continue;	// stale entry
+			const NavNode& n = nodes[id];
+			for (int k = 0; k < (int)n.links.size(); k++) {
+				const NavLink& l = n.links[k];
+				float g = cost_to[id] + l.cost;
+				if (stamp[l.to] == search && g >= cost_to[l.to]) continue;
+				stamp[l.to] = search;
+				cost_to[l.to] = g;
+				came_from[l.to] = { id, k };
+				open.push_back({ g + heuristic(l.to), l.to });
+				std::push_heap(open.begin(), open.end(), later);
+			}
+		}
+		if (stamp[to] != search) return false;
+
+		path.push_back({ to, -1 });
+		for (int id = to; came_from[id].node >= 0; id = came_from[id].node) {
+			path.push_back(came_from[id]);
+		}
+		std::reverse(path.begin(), path.end());
+		return true;
+	}
+};
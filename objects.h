@@ -0,0 +1,163 @@
+#pragma once
+#include <memory>
+#include "olcPixelGameEngine.h"
+#include "sprite_batch.h"
+
+enum BounceDeathActions {
+	DO_NOTHING = 0,
+	EXPLOSION_LARGE
+};
+
+class PhysicsObject {
+public:
+	olc::vf2d v;
+	olc::vf2d a;
+	olc::vf2d pos;
+	float friction = 0.8f;
+	float buoyancy = 0.8f;	// times gravity times the density of the fluid around it, above 1 floats
+	float r;
+	int n_bounces = -1;
+	bool dead = false;
+	bool stable = false;
+
+	PhysicsObject(float r=10) : r(r) {}
+
+	// Not virtual: entities are stored and iterated per concrete kind, so every call site already
+	// knows the type. Every kind has its own draw(); this default is hidden by those that react.
+	int bounce_death_action() { return 0; }
+};
+
+class SpriteObject {
+public:
+	inline static AtlasSprite sprite;
+
+	float scaleX = 1;
+	float scaleY = 1;
+
+	SpriteObject(float desired_height=10) {
+		set_size(desired_height);
+	}
+
+	static void init_sprite(const AtlasSprite& atlas_sprite) {
+		sprite = atlas_sprite;
+	}
+
+	void set_size(float desired_height) {
+		if (sprite) {
+			// sprite.size.y*scale = desired_height
+			scaleX = desired_height / sprite.size.y;
+			scaleY = scaleX;
+		}
+	}
+
+	void set_size(float desired_width, float desired_height) {
+		if (sprite) {
+			// sprite.size.y*scale = desired_height
+			scaleX = desired_width / sprite.size.x;
+			scaleY = desired_height / sprite.size.y;
+		}
+	}
+};
+
+
+class Dummy : public PhysicsObject {
+public:
+	using PhysicsObject::PhysicsObject;
+
+	void draw(SpriteBatch& batch, const olc::vf2d& offset) {
+		olc::PixelGameEngine& canvas = batch.get_canvas();
+		float s = batch.get_view_scale();
+		canvas.DrawCircle((pos+offset)*s, r*s);
+		canvas.DrawLine((pos+offset)*s, (pos+offset + v.norm() * r)*s);
+	}
+};
+
+class Debris : public PhysicsObject {
+public:
+	inline static AtlasSprite sprite;
+	float scale = 1;
+	float default_size = 8;
+
+	Debris(int r = 4) : PhysicsObject(r) {
+		n_bounces = 3;
+	}
+
+	void draw(SpriteBatch& batch, const olc::vf2d& offset) {
+		batch.add_rotated(sprite, pos+offset, atan2(v.y, v.x), {default_size*scale/2,default_size*scale/2}, {scale,scale}, olc::GREEN);
+	}
+
+	void set_size(float size) {
+		// default_size*x = size
+		scale = size / default_size;
+		r = size;
+	}
+
+	int bounce_death_action() {
+		dead = true;
+		return 0;
+	}
+};
+
+
+class Missile : public PhysicsObject {
+public:
+	static constexpr float missile_r = 10;
+	static constexpr float missile_friction = 0.8f;
+	static constexpr float launch_speed = 60;	// at full strength
+	static constexpr float muzzle_offset = 16;	// from the shooter's centre to where a missile starts
+
+	inline static AtlasSprite sprite;
+	float scale = 1;
+
+	Missile(float r = missile_r) : PhysicsObject(r) {
+		n_bounces = 0;
+		friction = missile_friction;
+		set_size(r);
+	}
+
+	void set_size(float radius) {
+		if (sprite) {
+			scale = radius / sprite.size.y;
+		}
+	}
+
+	void draw(SpriteBatch& batch, const olc::vf2d& offset) {
+		batch.add_rotated(sprite, pos + offset, atan2(v.y, v.x)-3.1415f/2, { sprite.size.x * scale / 2, sprite.size.y * scale / 2 }, { scale,scale });
+	}
+
+	int bounce_death_action() {
+		dead = true;
+		return 1;
+	}
+};
+
+
+class Worm : public PhysicsObject, public SpriteObject {
+public:
+	static constexpr float jump_force = 20;	// launch speed of a jump
+	static constexpr float troop_r = 6;	// radius of deployed troops
+	static constexpr float worm_friction = 0.4f;
+	static constexpr float worm_buoyancy = 1.4f;
+
+	int flip = 1;
+	int team = 0;
+
+	Worm(float r=10) : PhysicsObject(r), SpriteObject(r) {
+		n_bounces = -1;
+		friction = worm_friction;
+		buoyancy = worm_buoyancy;
+	}
+
+	void draw(SpriteBatch& batch, const olc::vf2d& offset) {
+		olc::vf2d draw_pos = pos + offset;
+		draw_pos.x -= r*flip;
+		draw_pos.y -= r;
+		batch.add(sprite, draw_pos, { scaleX*flip,scaleY });
+	}
+
+	void set_r(float r) {
+		this->r = r;
+		set_size(r*2, r*2);
+	}
+
+};
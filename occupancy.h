@@ -0,0 +1,171 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+enum Occupancy : uint8_t {
+	EMPTY = 0,
+	SOLID,
+	MIXED
+};
+
+// Hierarchical solid/empty summary of a cell grid.
+// Level 0 tiles cover (1 << base_shift) cells per side, every level above halves the tile count
+// until a single tile covers the whole map. Uniform tiles let queries skip whole areas at once.
+class OccupancyPyramid {
+	struct Level {
+		int tiles_x = 0;
+		int tiles_y = 0;
+		std::vector<uint8_t> tiles;
+	};
+
+	int width = 0;
+	int height = 0;
+	int base_shift = 3;
+	std::vector<Level> levels;
+
+	template <class IsSolid>
+	uint8_t scan_tile(int tx, int ty, IsSolid& is_solid) const {
+		int x0 = tx << base_shift;
+		int y0 = ty << base_shift;
+		int x1 = std::min(width, x0 + (1 << base_shift));
+		int y1 = std::min(height, y0 + (1 << base_shift));
+		bool any_solid = false;
+		bool any_empty = false;
+		for (int y = y0; y < y1; y++) {
+			for (int x = x0; x < x1; x++) {
+				if (is_solid(x, y)) any_solid = true;
+				else any_empty = true;
+				if (any_solid && any_empty) return MIXED;
+			}
+		}
+		return any_solid ? SOLID : EMPTY;
+	}
+
+	uint8_t combine_children(int level, int tx, int ty) const {
+		const Level& child = levels[level - 1];
+		int cx1 = std::min(child.tiles_x, tx * 2 + 2);
+		int cy1 = std::min(child.tiles_y, ty * 2 + 2);
+		uint8_t first = child.tiles[ty * 2 * child.tiles_x + tx * 2];
+		if (first == MIXED) return MIXED;
+		for (int cy = ty * 2; cy < cy1; cy++) {
+			for (int cx = tx * 2; cx < cx1; cx++) {
+				if (child.tiles[cy * child.tiles_x + cx] != first) return MIXED;
+			}
+		}
+		return first;
+	}
+
+	template <class Fn>
+	void visit(int level, int tx, int ty, int x0, int y0, int x1, int y1, Fn& fn) const {
+		int size = tile_size(level);
+		int bx0 = tx * size;
+		int by0 = ty * size;
+		int bx1 = std::min(width, bx0 + size);
+		int by1 = std::min(height, by0 + size);
+		if (bx1 <= x0 || by1 <= y0 || bx0 >= x1 || by0 >= y1) return;
+
+		uint8_t state = levels[level].tiles[ty * levels[level].tiles_x + tx];
+		if (state != MIXED || level == 0) {
+			int cx0 = std::max(bx0, x0);
+			int cy0 = std::max(by0, y0);
+			fn(cx0, cy0, std::min(bx1, x1) - cx0, std::min(by1, y1) - cy0, (Occupancy)state);
+			return;
+		}
+		for (int cy = ty * 2; cy < std::min(levels[level - 1].tiles_y, ty * 2 + 2); cy++) {
+			for (int cx = tx * 2; cx < std::min(levels[level - 1].tiles_x, tx * 2 + 2); cx++) {
+				visit(level - 1, cx, cy, x0, y0, x1, y1, fn);
+			}
+		}
+	}
+
+public:
+	template <class IsSolid>
+	void build(int width, int height, IsSolid is_solid, int base_shift = 3) {
+		this->width = width;
+		this->height = height;
+		this->base_shift = base_shift;
+		levels.clear();
+
+		int tiles_x = (width + (1 << base_shift) - 1) >> base_shift;
+		int tiles_y = (height + (1 << base_shift) - 1) >> base_shift;
+		while (true) {
+			Level level;
+			level.tiles_x = tiles_x;
+			level.tiles_y = tiles_y;
+			level.tiles.assign(tiles_x * tiles_y, EMPTY);
+			levels.push_back(std::move(level));
+			if (tiles_x == 1 && tiles_y == 1) break;
+			tiles_x = (tiles_x + 1) / 2;
+			tiles_y = (tiles_y + 1) / 2;
+		}
+		update(0, 0, width - 1, height - 1, is_solid);
+	}
+
+	// Re-evaluates every tile touching the inclusive cell rectangle, then the tiles above them.
+	template <class IsSolid>
+	void update(int x0, int y0, int x1, int y1, IsSolid is_solid) {
+		if (levels.empty()) return;
+		x0 = std::max(0, x0);
+		y0 = std::max(0, y0);
+		x1 = std::min(width - 1, x1);
+		y1 = std::min(height - 1, y1);
+		if (x0 > x1 || y0 > y1) return;
+
+		int tx0 = x0 >> base_shift;
+		int ty0 = y0 >> base_shift;
+		int tx1 = x1 >> base_shift;
+		int ty1 = y1 >> base_shift;
+		Level& base = levels[0];
+		for (int ty = ty0; ty <= ty1; ty++) {
+			for (int tx = tx0; tx <= tx1; tx++) {
+				base.tiles[ty * base.tiles_x + tx] = scan_tile(tx, ty, is_solid);
+			}
+		}
+
+		for (int l = 1; l < (int)levels.size(); l++) {
+			tx0 >>= 1; ty0 >>= 1; tx1 >>= 1; ty1 >>= 1;
+			Level& level = levels[l];
+			for (int ty = ty0; ty <= ty1; ty++) {
+				for (int tx = tx0; tx <= tx1; tx++) {
+					level.tiles[ty * level.tiles_x + tx] = combine_children(l, tx, ty);
+				}
+			}
+		}
+	}
+
+	int get_levels() const { return (int)levels.size(); }
+	int get_base_shift() const { return base_shift; }
+	int tile_shift(int level) const { return base_shift + level; }
+	int tile_size(int level) const { return 1 << (base_shift + level); }
+	int tiles_x(int level) const { return levels[level].tiles_x; }
+	int tiles_y(int level) const { return levels[level].tiles_y; }
+
+	Occupancy get(int level, int tx, int ty) const {
+		const Level& l = levels[level];
+		return (Occupancy)l.tiles[ty * l.tiles_x + tx];
+	}
+
+	// Highest level whose tile containing cell (x, y) is uniform, or -1 if even the
+	// level 0 tile is mixed. state receives the tile's occupancy.
+	int largest_uniform(int x, int y, Occupancy& state) const {
+		for (int l = (int)levels.size() - 1; l >= 0; l--) {
+			const Level& level = levels[l];
+			uint8_t s = level.tiles[(y >> tile_shift(l)) * level.tiles_x + (x >> tile_shift(l))];
+			if (s != MIXED) {
+				state = (Occupancy)s;
+				return l;
+			}
+		}
+		state = MIXED;
+		return -1;
+	}
+
+	// Covers the cell rectangle [x0, x1) x [y0, y1) with the largest tiles possible.
+	// fn(x, y, w, h, state) is called per block; MIXED blocks are always level 0 tiles.
+	template <class Fn>
+	void for_each_block(int x0, int y0, int x1, int y1, Fn fn) const {
+		if (levels.empty()) return;
+		visit((int)levels.size() - 1, 0, 0, x0, y0, x1, y1, fn);
+	}
+};
@@ -0,0 +1,122 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <bit>
+#include "olcPixelGameEngine.h"
+
+#if defined(__SSSE3__) || defined(__AVX__)
+#include <tmmintrin.h>
+#define PALETTE_SSSE3 1
+#endif
+
+// Colours for up to 16 terrain materials, expanded a whole row at a time.
+// The colours are also kept as four 16 byte planes (all reds, all greens, ...), so with SSSE3
+// one pshufb per plane looks up 16 cells at once. Builds without SSSE3 (MSVC defines __AVX__
+// under /arch:AVX and up) fall back to a plain table lookup.
+// A material can instead take its colour from a tiled texture, sampled at the cell's map position.
+class Palette {
+public:
+	static constexpr int size = 16;
+
+private:
+	olc::Pixel colors[size];
+	alignas(16) uint8_t planes[4][size] = {};
+	olc::Sprite* textures[size] = {};
+	uint32_t textured = 0;	// bit per material
+
+	// First index from i on whose material is (or with equal false, is not) m. count if there is none.
+	static int find(const uint8_t* materials, int count, int i, int m, bool equal) {
+#ifdef PALETTE_SSSE3
+		const __m128i low_bits = _mm_set1_epi8(0x0F);
+		const __m128i want = _mm_set1_epi8((char)m);
+		for (; i + 16 <= count; i += 16) {
+			__m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*)(materials + i)), low_bits);
+			unsigned hits = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, want));
+			if (!equal) hits ^= 0xFFFF;
+			if (hits) return i + std::countr_zero(hits);
+		}
+#endif
+		for (; i < count; i++) {
+			if (((materials[i] & 0x0F) == m) == equal) return i;
+		}
+		return count;
+	}
+
+public:
+	Palette() {
+		for (int i = 0; i < size; i++) set(i, olc::BLACK);
+	}
+
+	void set(int material, olc::Pixel color) {
+		colors[material] = color;
+		planes[0][material] = color.r;
+		planes[1][material] = color.g;
+		planes[2][material] = color.b;
+		planes[3][material] = color.a;
+	}
+
+	// Width and height of texture must be powers of two. nullptr goes back to the flat colour.
+	void set_texture(int material, olc::Sprite* texture) {
+		textures[material] = texture;
+		if (texture) textured |= 1u << material;
+		else textured &= ~(1u << material);
+	}
+
+	olc::Pixel get(int material) const { return colors[material]; }
+
+	olc::Pixel sample(int material, int x, int y) const {
+		olc::Sprite* t = textures[material];
+		if (!t) return colors[material];
+		return t->GetData()[(y & (t->height - 1)) * t->width + (x & (t->width - 1))];
+	}
+
+	// Writes the colours of count cells, the first at map position (x, y), to out
+	void expand_row(const uint8_t* materials, int count, int x, int y, olc::Pixel* out) const {
+		int i = 0;
+#ifdef PALETTE_SSSE3
+		const __m128i low_bits = _mm_set1_epi8(0x0F);
+		const __m128i r = _mm_load_si128((const __m128i*)planes[0]);
+		const __m128i g = _mm_load_si128((const __m128i*)planes[1]);
+		const __m128i b = _mm_load_si128((const __m128i*)planes[2]);
+		const __m128i a = _mm_load_si128((const __m128i*)planes[3]);
+		for (; i + 16 <= count; i += 16) {
+			__m128i m = _mm_and_si128(_mm_loadu_si128((const __m128i*)(materials + i)), low_bits);
+			__m128i pr = _mm_shuffle_epi8(r, m);
+			__m128i pg = _mm_shuffle_epi8(g, m);
+			__m128i pb = _mm_shuffle_epi8(b, m);
+			__m128i pa = _mm_shuffle_epi8(a, m);
+			// Interleave the planes back into r, g, b, a byte order, 4 pixels per register
+			__m128i rg_lo = _mm_unpacklo_epi8(pr, pg);
+			__m128i rg_hi = _mm_unpackhi_epi8(pr, pg);
+			__m128i ba_lo = _mm_unpacklo_epi8(pb, pa);
+			__m128i ba_hi = _mm_unpackhi_epi8(pb, pa);
+			__m128i* dst = (__m128i*)(out + i);
+			_mm_storeu_si128(dst + 0, _mm_unpacklo_epi16(rg_lo, ba_lo));
+			_mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(rg_lo, ba_lo));
+			_mm_storeu_si128(dst + 2, _mm_unpacklo_epi16(rg_hi, ba_hi));
+			_mm_storeu_si128(dst + 3, _mm_unpackhi_epi16(rg_hi, ba_hi));
+		}
+#endif
+		for (; i < count; i++) {
+			out[i] = colors[materials[i] & 0x0F];
+		}
+
+		if (!textured) return;
+		// Runs of a textured material are copied from the texture row, wrapping at its edge
+		for (int m = 0; m < size; m++) {
+			if (!(textured & (1u << m))) continue;
+			olc::Sprite* t = textures[m];
+			const olc::Pixel* texels = t->GetData() + (y & (t->height - 1)) * t->width;
+			for (i = find(materials, count, 0, m, true); i < count; i = find(materials, count, i, m, true)) {
+				int end = find(materials, count, i, m, false);
+				while (i < end) {
+					int tx = (x + i) & (t->width - 1);
+					int n = std::min(end - i, t->width - tx);
+					memcpy(out + i, texels + tx, n * sizeof(olc::Pixel));
+					i += n;
+				}
+			}
+		}
+	}
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include <cmath>
+#include <algorithm>
+#include "olcPixelGameEngine.h"
+
+// Integrator and terrain collision response shared by the game loop and every headless simulation.
+// Obj is anything with the PhysicsObject fields (pos, v, a, r, friction, buoyancy, n_bounces, dead, stable),
+// TerrainT anything with get_width(), get_height(), is_solid(x, y), friction(x, y) and density(x, y).
+
+const olc::vf2d gravity = { 0, 10 };
+const float fluid_drag = 3.0f;	// fraction of the velocity a fluid of density 1 takes away per second
+
+// Advances obj by one substep. Returns true if it hit the terrain, in which case it bounced in place
+// instead of moving.
+template <class Obj, class TerrainT>
+bool integrate(Obj& obj, const TerrainT& terrain, float dt) {
+	obj.a += gravity;
+
+	// A fluid at the centre pushes up against gravity by its density times the object's buoyancy
+	float density = 0;
+	if (obj.pos.x >= 0 && obj.pos.x < terrain.get_width() && obj.pos.y >= 0 && obj.pos.y < terrain.get_height()) {
+		density = terrain.density(obj.pos.x, obj.pos.y);
+	}
+	if (density > 0) {
+		obj.a -= gravity * (density * obj.buoyancy);
+		obj.v *= std::max(0.0f, 1.0f - fluid_drag * density * dt);
+	}
+	obj.v += obj.a * dt;
+
+	olc::vf2d potential_pos = obj.pos + obj.v * dt;
+	float v_angle = std::atan2(obj.v.y, obj.v.x);
+	olc::vf2d vec_response = { 0,0 };
+	bool b_collision = false;
+	float contact_friction = 0;
+	int contacts = 0;
+	for (float a = v_angle - 3.1415f / 2; a < v_angle + 3.1415f / 2; a += 3.1415f / 8) {
+		olc::vf2d vec_mv = { cosf(a) * obj.r, sinf(a) * obj.r };
+		olc::vf2d test_pos = potential_pos + vec_mv;
+
+		if (test_pos.x < 0 || test_pos.x >= terrain.get_width() || test_pos.y < 0 || test_pos.y >= terrain.get_height()) {
+			obj.dead = true;
+			continue;
+		}
+
+		if (terrain.is_solid(test_pos.x, test_pos.y)) {
+			b_collision = true;
+			vec_response += vec_mv;
+			contact_friction += terrain.friction(test_pos.x, test_pos.y);
+			contacts++;
+		}
+	}
+
+	if (b_collision) {
+		vec_response *= -1;
+		vec_response = vec_response.norm();
+		obj.v = obj.v - 2 * (obj.v.dot(vec_response)) * vec_response;
+		// The materials touched scale the object's own friction
+		obj.v *= std::min(1.0f, obj.friction * contact_friction / contacts);
+		if (obj.v.mag() < 1.0f) {
+			obj.stable = true;
+			obj.v.x = 0;
+			obj.v.y = 0;
+		}
+	}
+	else {
+		obj.pos = potential_pos;
+		// Something that floats comes to rest once it drifts slowly at the surface
+		if (density > 0 && obj.buoyancy > 1 && !obj.dead && obj.v.mag() < 1.0f && obj.pos.y >= 1 && terrain.density(obj.pos.x, obj.pos.y - 1) == 0) {
+			obj.stable = true;
+			obj.v.x = 0;
+			obj.v.y = 0;
+		}
+	}
+
+	obj.a = olc::vf2d(0, 0);
+	return b_collision;
+}
+
+// Counts one bounce. Returns true exactly once, on the bounce where the object runs out of
+// bounces and its bounce_death_action should fire.
+template <class Obj>
+bool count_bounce(Obj& obj) {
+	if (obj.n_bounces > 0) {
+		obj.n_bounces--;
+	}
+	else if (obj.n_bounces == 0) {
+		obj.n_bounces--;
+		return true;
+	}
+	return false;
+}
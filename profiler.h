@@ -0,0 +1,203 @@
+#pragma once
+#include <array>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <algorithm>
+#include "olcPixelGameEngine.h"
+#include "trace.h"
+#include "alloc_tracker.h"
+
+// Frame stages timed by PROFILE_SCOPE. A stage entered several times in a frame adds up.
+enum ProfileStage {
+	PROFILE_FRAME,
+	PROFILE_INPUT,
+	PROFILE_STATE,
+	PROFILE_PHYSICS,
+	PROFILE_SUBSTEP,
+	PROFILE_SAND,
+	PROFILE_WATER,
+	PROFILE_TERRAIN_DRAW,
+	PROFILE_LIGHTING,
+	PROFILE_OBJECT_DRAW,
+	PROFILE_OVERLAY,
+	PROFILE_STAGE_COUNT
+};
+
+inline const char* profile_stage_name(ProfileStage stage) {
+	static const char* names[PROFILE_STAGE_COUNT] = {
+		"frame", "input", "state", "physics", "substep", "sand", "water", "terrain", "light", "objects", "overlay"
+	};
+	return names[stage];
+}
+
+// Per stage timings of the last history_size frames.
+// Off by default: a scope then costs one predictable branch. Only the thread that calls
+// begin_frame() records, so worlds stepped on pool threads do not race on the totals.
+// Defining WORMS_NO_PROFILER compiles the scopes out entirely.
+class Profiler {
+public:
+	static constexpr int history_size = 256;
+
+	struct Stats {
+		float min = 0;
+		float avg = 0;
+		float p99 = 0;
+	};
+
+private:
+	// Read by scopes on pool threads while the owner toggles and begins frames
+	std::atomic<bool> enabled{ false };
+	std::atomic<std::thread::id> owner;
+	std::array<float, PROFILE_STAGE_COUNT> current = {};
+	std::array<std::array<float, history_size>, PROFILE_STAGE_COUNT> history = {};
+	int frames = 0;	// frames recorded so far, the newest at (frames - 1) % history_size
+	AllocCounts frame_allocs;	// of the last frame, only counted with WORMS_TRACK_ALLOCATIONS
+	std::array<AllocCounts, PROFILE_STAGE_COUNT> stage_allocs = {};
+
+public:
+	static Profiler& shared() {
+		static Profiler profiler;
+		return profiler;
+	}
+
+	bool is_enabled() const { return enabled.load(std::memory_order_relaxed); }
+
+	void set_enabled(bool enabled) {
+		this->enabled.store(enabled, std::memory_order_relaxed);
+		frames = 0;
+	}
+
+	bool is_recording() const {
+		return enabled.load(std::memory_order_relaxed) && std::this_thread::get_id() == owner.load(std::memory_order_relaxed);
+	}
+
+	void begin_frame() {
+		owner.store(std::this_thread::get_id(), std::memory_order_relaxed);
+		current.fill(0);
+	}
+
+	void end_frame() {
+		if (AllocTracker::enabled) {
+			frame_allocs = AllocTracker::take_frame();
+			for (int s = 0; s < PROFILE_STAGE_COUNT; s++) {
+				stage_allocs[s] = AllocTracker::take_scope(s);
+			}
+		}
+		if (!is_enabled()) return;
+		for (int s = 0; s < PROFILE_STAGE_COUNT; s++) {
+			history[s][frames % history_size] = current[s];
+		}
+		frames++;
+	}
+
+	void add(ProfileStage stage, float ms) { current[stage] += ms; }
+
+	int get_frame_count() const { return std::min(frames, history_size); }
+
+	// Allocations of the last frame, in total and made directly inside each stage (nested stages count separately)
+	const AllocCounts& get_frame_allocs() const { return frame_allocs; }
+	const AllocCounts& get_stage_allocs(ProfileStage stage) const { return stage_allocs[stage]; }
+
+	// Over the frames still in the history, in milliseconds
+	Stats get_stats(ProfileStage stage) const {
+		Stats stats;
+		int n = get_frame_count();
+		if (n == 0) return stats;
+		std::array<float, history_size> sorted;
+		std::copy(history[stage].begin(), history[stage].begin() + n, sorted.begin());
+		std::sort(sorted.begin(), sorted.begin() + n);
+		float sum = 0;
+		for (int i = 0; i < n; i++) sum += sorted[i];
+		stats.min = sorted[0];
+		stats.avg = sum / n;
+		stats.p99 = sorted[std::min(n - 1, n * 99 / 100)];
+		return stats;
+	}
+
+	void draw(olc::PixelGameEngine& canvas, int x, int y) const {
+		int rows = PROFILE_STAGE_COUNT + (AllocTracker::enabled ? 3 : 1);
+		canvas.FillRect(x, y, AllocTracker::enabled ? 248 : 200, 10 * rows + 2, olc::VERY_DARK_GREY);
+		canvas.DrawString(x + 2, y + 2, AllocTracker::enabled ? "ms       min   avg   p99 new" : "ms       min   avg   p99", olc::YELLOW);
+		char line[64];
+		for (int s = 0; s < PROFILE_STAGE_COUNT; s++) {
+			Stats st = get_stats((ProfileStage)s);
+			int n = snprintf(line, sizeof(line), "%-7s %5.2f %5.2f %5.2f", profile_stage_name((ProfileStage)s), st.min, st.avg, st.p99);
+			if (AllocTracker::enabled) snprintf(line + n, sizeof(line) - n, " %3d", (int)stage_allocs[s].allocs);
+			canvas.DrawString(x + 2, y + 12 + s * 10, line);
+		}
+		if (AllocTracker::enabled) {
+			int ly = y + 12 + PROFILE_STAGE_COUNT * 10;
+			snprintf(line, sizeof(line), "new %d delete %d", (int)frame_allocs.allocs, (int)frame_allocs.frees);
+			canvas.DrawString(x + 2, ly, line);
+			snprintf(line, sizeof(line), "%d bytes, %d violations", (int)frame_allocs.bytes, (int)AllocTracker::get_violations());
+			canvas.DrawString(x + 2, ly + 10, line, AllocTracker::get_violations() ? olc::RED : olc::WHITE);
+		}
+	}
+
+	// One row per frame in the history, oldest first, one column per stage
+	bool dump_csv(const std::string& file) const {
+		std::ofstream out(file);
+		for (int s = 0; s < PROFILE_STAGE_COUNT; s++) {
+			out << (s ? "," : "") << profile_stage_name((ProfileStage)s);
+		}
+		out << '\n';
+		int n = get_frame_count();
+		for (int f = frames - n; f < frames; f++) {
+			for (int s = 0; s < PROFILE_STAGE_COUNT; s++) {
+				out << (s ? "," : "") << history[s][f % history_size];
+			}
+			out << '\n';
+		}
+		return (bool)out;
+	}
+
+	// Summary per stage: { "frames": n, "stages": { "physics": { "min": .., "avg": .., "p99": .. }, ... } }
+	bool dump_json(const std::string& file) const {
+		std::ofstream out(file);
+		out << "{\n\t\"frames\": " << get_frame_count() << ",\n\t\"stages\": {\n";
+		for (int s = 0; s < PROFILE_STAGE_COUNT; s++) {
+			Stats st = get_stats((ProfileStage)s);
+			out << "\t\t\"" << profile_stage_name((ProfileStage)s) << "\": { \"min\": " << st.min
+				<< ", \"avg\": " << st.avg << ", \"p99\": " << st.p99 << " }"
+				<< (s + 1 < PROFILE_STAGE_COUNT ? "," : "") << '\n';
+		}
+		out << "\t}\n}\n";
+		return (bool)out;
+	}
+};
+
+// Adds the time until the end of the enclosing block to a stage, and traces the block while tracing is on
+class ProfileScope {
+	ProfileStage stage;
+	bool active;
+	TraceScope trace;
+#ifdef WORMS_TRACK_ALLOCATIONS
+	AllocScope alloc;
+#endif
+	std::chrono::steady_clock::time_point start;
+
+public:
+	ProfileScope(ProfileStage stage) : stage(stage), active(Profiler::shared().is_recording()), trace(profile_stage_name(stage))
+#ifdef WORMS_TRACK_ALLOCATIONS
+		, alloc(stage)
+#endif
+	{
+		if (active) start = std::chrono::steady_clock::now();
+	}
+
+	~ProfileScope() {
+		if (!active) return;
+		std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		Profiler::shared().add(stage, elapsed.count());
+	}
+};
+
+#ifdef WORMS_NO_PROFILER
+#define PROFILE_SCOPE(stage)
+#else
+#define PROFILE_SCOPE(stage) ProfileScope TRACE_CONCAT(profile_scope_, __LINE__)(stage)
+#endif
@@ -0,0 +1,140 @@
+#pragma once
+#include <cmath>
+#include <limits>
+#include "olcPixelGameEngine.h"
+#include "terrain.h"
+#include "thread_pool.h"
+
+struct Ray {
+	olc::vf2d origin;
+	olc::vf2d dir;
+	float max_dist = 1000;
+};
+
+struct RayHit {
+	bool hit = false;
+	olc::vf2d pos;
+	float distance = 0;
+	olc::vf2d normal;
+};
+
+// Surface normal at a solid cell, estimated from the solid cells around it.
+// Falls back to the given face normal on flat interiors where the estimate cancels out.
+template <class TerrainT>
+olc::vf2d terrain_normal(const TerrainT& terrain, int cx, int cy, const olc::vf2d& fallback) {
+	const int radius = 2;
+	olc::vf2d sum = { 0, 0 };
+	for (int dy = -radius; dy <= radius; dy++) {
+		for (int dx = -radius; dx <= radius; dx++) {
+			int x = cx + dx;
+			int y = cy + dy;
+			if (terrain.in_bounds(x, y) && terrain.is_solid(x, y)) {
+				sum += olc::vf2d((float)dx, (float)dy);
+			}
+		}
+	}
+	if (sum.mag2() < 0.01f) return fallback;
+	return (sum * -1).norm();
+}
+
+// Amanatides-Woo grid traversal that jumps over whole empty occupancy tiles.
+// dir does not need to be normalised; max_dist is measured in cells along it.
+template <class TerrainT>
+RayHit raycast(const TerrainT& terrain, olc::vf2d origin, olc::vf2d dir, float max_dist) {
+	RayHit result;
+	float len = dir.mag();
+	if (len <= 0) return result;
+	dir /= len;
+
+	const float inf = std::numeric_limits<float>::infinity();
+	const float w = (float)terrain.get_width();
+	const float h = (float)terrain.get_height();
+
+	// Clip the ray against the map so traversal always starts inside it
+	float t = 0;
+	float t_end = max_dist;
+	for (int axis = 0; axis < 2; axis++) {
+		float o = axis == 0 ? origin.x : origin.y;
+		float d = axis == 0 ? dir.x : dir.y;
+		float hi = axis == 0 ? w : h;
+		if (d == 0) {
+			if (o < 0 || o >= hi) return result;
+			continue;
+		}
+		float t0 = (0 - o) / d;
+		float t1 = (hi - o) / d;
+		if (t0 > t1) std::swap(t0, t1);
+		t = std::max(t, t0);
+		t_end = std::min(t_end, t1);
+	}
+	if (t > t_end) return result;
+
+	olc::vf2d start = origin + dir * t;
+	int cx = std::min((int)w - 1, std::max(0, (int)std::floor(start.x)));
+	int cy = std::min((int)h - 1, std::max(0, (int)std::floor(start.y)));
+	int step_x = dir.x > 0 ? 1 : -1;
+	int step_y = dir.y > 0 ? 1 : -1;
+	olc::vf2d face = dir * -1;
+
+	const OccupancyPyramid& occupancy = terrain.get_occupancy();
+	while (t <= t_end) {
+		if (!terrain.in_bounds(cx, cy)) return result;
+
+		Occupancy state;
+		int level = occupancy.largest_uniform(cx, cy, state);
+		int x0 = cx, y0 = cy, size = 1;
+		if (level >= 0) {
+			if (state == SOLID) {
+				result.hit = true;
+				break;
+			}
+			size = occupancy.tile_size(level);
+			x0 = cx & ~(size - 1);
+			y0 = cy & ~(size - 1);
+		}
+		else if (terrain.is_solid(cx, cy)) {
+			result.hit = true;
+			break;
+		}
+
+		// Leave the current block (a single cell or a whole empty tile) through its nearest face
+		float tx = dir.x == 0 ? inf : ((dir.x > 0 ? x0 + size : x0) - origin.x) / dir.x;
+		float ty = dir.y == 0 ? inf : ((dir.y > 0 ? y0 + size : y0) - origin.y) / dir.y;
+		if (tx < ty) {
+			t = tx;
+			cx = dir.x > 0 ? x0 + size : x0 - 1;
+			cy = std::min(y0 + size - 1, std::max(y0, (int)std::floor(origin.y + dir.y * t)));
+			face = { (float)-step_x, 0 };
+		}
+		else {
+			t = ty;
+			cy = dir.y > 0 ? y0 + size : y0 - 1;
+			cx = std::min(x0 + size - 1, std::max(x0, (int)std::floor(origin.x + dir.x * t)));
+			face = { 0, (float)-step_y };
+		}
+	}
+
+	if (result.hit) {
+		result.distance = t;
+		result.pos = origin + dir * t;
+		result.normal = terrain_normal(terrain, cx, cy, face);
+	}
+	return result;
+}
+
+// Casts count rays, writing one RayHit per ray. Large batches are spread across the shared thread pool.
+template <class TerrainT>
+void raycast_batch(const TerrainT& terrain, const Ray* rays, RayHit* hits, int count, bool parallel = true) {
+	const int grain = 256;
+	if (!parallel || count <= grain) {
+		for (int i = 0; i < count; i++) {
+			hits[i] = raycast(terrain, rays[i].origin, rays[i].dir, rays[i].max_dist);
+		}
+		return;
+	}
+	ThreadPool::shared().parallel_for(0, count, grain, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			hits[i] = raycast(terrain, rays[i].origin, rays[i].dir, rays[i].max_dist);
+		}
+	});
+}
@@ -0,0 +1,156 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include "terrain.h"
+#include "thread_pool.h"
+
+// Falling sand cellular automaton over the granular materials of a Terrain.
+//
+// The map is split into 32x32 chunks and only active chunks are simulated. Explosions wake the
+// chunks they touch through wake(); a chunk in which a grain moved wakes itself and its eight
+// neighbours for the next tick, and one where nothing moved goes back to sleep. A settled map
+// therefore costs nothing, and a collapse costs in proportion to the chunks it keeps moving.
+//
+// A grain moves at most one cell, so it only ever writes into its own chunk or a neighbour.
+// Each tick runs four passes, one per (x & 1, y & 1) chunk parity. The chunks of a pass are two
+// apart, so they never share a neighbour cell (or, chunks being an even number of cells wide, a
+// packed byte) and run in parallel on the pool.
+class FallingSand {
+public:
+	static constexpr int chunk_shift = 5;
+	static constexpr int chunk_size = 1 << chunk_shift;
+
+private:
+	struct DirtyRect {
+		int x0, y0, x1, y1;	// inclusive, empty while x0 > x1
+	};
+
+	int chunks_x = 0;
+	int chunks_y = 0;
+	std::vector<uint8_t> active;
+	std::vector<std::atomic<uint8_t>> next_active;	// several chunks of a pass may wake the same neighbour
+	std::vector<DirtyRect> dirty;
+	std::vector<int> pass_chunks;
+	unsigned tick = 0;
+	int active_chunks = 0;
+	int moved_chunks = 0;
+
+	void wake_around(int cx, int cy) {
+		for (int y = std::max(0, cy - 1); y <= std::min(chunks_y - 1, cy + 1); y++) {
+			for (int x = std::max(0, cx - 1); x <= std::min(chunks_x - 1, cx + 1); x++) {
+				next_active[y * chunks_x + x].store(1, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	static bool can_enter(const Terrain& terrain, int x, int y) {
+		return terrain.in_bounds(x, y) && !terrain.is_solid(x, y);
+	}
+
+	// Moves the grain at (x, y) by one cell, swapping with whatever fluid or air was there
+	static void move(Terrain& terrain, int x, int y, int nx, int ny, DirtyRect& d) {
+		TerrainType grain = terrain.get(x, y);
+		terrain.set(x, y, terrain.get(nx, ny));
+		terrain.set(nx, ny, grain);
+		d.x0 = std::min(d.x0, std::min(x, nx));
+		d.x1 = std::max(d.x1, std::max(x, nx));
+		d.y0 = std::min(d.y0, y);
+		d.y1 = std::max(d.y1, ny);
+	}
+
+	void simulate_chunk(Terrain& terrain, int chunk) {
+		int cx = chunk % chunks_x;
+		int cy = chunk / chunks_x;
+		int x0 = cx * chunk_size;
+		int x1 = std::min(x0 + chunk_size, terrain.get_width());
+		int y0 = cy * chunk_size;
+		int y1 = std::min(y0 + chunk_size, terrain.get_height());
+		DirtyRect d = { x1, y1, x0 - 1, y0 - 1 };
+
+		// Bottom up, so a grain that fell is not visited again. The sweep direction alternates per
+		// row and tick to keep piles from leaning one way.
+		for (int y = y1 - 1; y >= y0; y--) {
+			bool left_to_right = ((y + tick) & 1) != 0;
+			int dir = left_to_right ? 1 : -1;
+			for (int k = 0; k < x1 - x0; k++) {
+				int x = left_to_right ? x0 + k : x1 - 1 - k;
+				if (!material_table[terrain.get(x, y)].granular) continue;
+				if (can_enter(terrain, x, y + 1)) {
+					move(terrain, x, y, x, y + 1, d);
+				}
+				else if (can_enter(terrain, x + dir, y + 1) && can_enter(terrain, x + dir, y)) {
+					move(terrain, x, y, x + dir, y + 1, d);
+				}
+				else if (can_enter(terrain, x - dir, y + 1) && can_enter(terrain, x - dir, y)) {
+					move(terrain, x, y, x - dir, y + 1, d);
+				}
+			}
+		}
+
+		dirty[chunk] = d;
+		if (d.x0 <= d.x1) wake_around(cx, cy);
+	}
+
+public:
+	void resize(int width, int height) {
+		chunks_x = (width + chunk_size - 1) >> chunk_shift;
+		chunks_y = (height + chunk_size - 1) >> chunk_shift;
+		active.assign(chunks_x * chunks_y, 0);
+		active_chunks = 0;
+		std::vector<std::atomic<uint8_t>>(chunks_x * chunks_y).swap(next_active);
+		dirty.assign(chunks_x * chunks_y, DirtyRect{ 0, 0, -1, -1 });
+		pass_chunks.reserve(chunks_x * chunks_y);
+	}
+
+	// Activates every chunk within a cell of the inclusive rectangle
+	void wake(int x0, int y0, int x1, int y1) {
+		int cx0 = std::max(0, (x0 - 1) >> chunk_shift);
+		int cy0 = std::max(0, (y0 - 1) >> chunk_shift);
+		int cx1 = std::min(chunks_x - 1, (x1 + 1) >> chunk_shift);
+		int cy1 = std::min(chunks_y - 1, (y1 + 1) >> chunk_shift);
+		for (int cy = cy0; cy <= cy1; cy++) {
+			for (int cx = cx0; cx <= cx1; cx++) {
+				active_chunks += !active[cy * chunks_x + cx];
+				active[cy * chunks_x + cx] = 1;
+			}
+		}
+	}
+
+	// One tick over the active chunks. Calls on_moved(x0, y0, x1, y1) with the inclusive rectangle
+	// of each chunk in which something moved, after the terrain has been refreshed over it.
+	template <class Fn>
+	void step(Terrain& terrain, Fn on_moved) {
+		moved_chunks = 0;
+		if (active_chunks == 0) return;
+		for (int parity = 0; parity < 4; parity++) {
+			pass_chunks.clear();
+			for (int cy = parity >> 1; cy < chunks_y; cy += 2) {
+				for (int cx = parity & 1; cx < chunks_x; cx += 2) {
+					if (active[cy * chunks_x + cx]) pass_chunks.push_back(cy * chunks_x + cx);
+				}
+			}
+			ThreadPool::shared().parallel_for(0, (int)pass_chunks.size(), 2, [&](int begin, int end) {
+				for (int i = begin; i < end; i++) simulate_chunk(terrain, pass_chunks[i]);
+			});
+		}
+
+		active_chunks = 0;
+		for (int c = 0; c < chunks_x * chunks_y; c++) {
+			if (active[c] && dirty[c].x0 <= dirty[c].x1) {
+				const DirtyRect& d = dirty[c];
+				terrain.refresh(d.x0, d.y0, d.x1, d.y1);
+				on_moved(d.x0, d.y0, d.x1, d.y1);
+				moved_chunks++;
+			}
+			dirty[c] = { 0, 0, -1, -1 };
+			active[c] = next_active[c].exchange(0, std::memory_order_relaxed);
+			active_chunks += active[c];
+		}
+		tick++;
+	}
+
+	int get_active_chunks() const { return active_chunks; }
+
+	int get_moved_chunks() const { return moved_chunks; }
+};
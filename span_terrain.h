@@ -0,0 +1,232 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+#include "olcPixelGameEngine.h"
+#include "terrain.h"
+#include "palette.h"
+
+// A run of cells of one material in a column, from y0 up to but not including y1
+struct TerrainSpan {
+	uint16_t y0;
+	uint16_t y1;
+	TerrainType type;
+};
+
+// Terrain stored as a sorted list of non-sky spans per column, an alternative to the dense Terrain.
+// Heightmap maps hold a handful of spans per column whatever their height, so memory follows the
+// number of material boundaries rather than the area. Point queries binary search the column,
+// carve_crater() and fill() work on whole spans and blit() fills spans straight into the target.
+// A benchmark-only alternative for now: World, TerrainImage and raycast() take the dense Terrain,
+// and only --bench-terrain uses the spans, to compare the two. The cell queries match Terrain's,
+// so the templated integrator and trajectory predictor would accept it.
+// There is no edit log: changed_since() reports any edit since a revision as touching everything.
+class SpanTerrain {
+	int width = 0;
+	int height = 0;
+	std::vector<std::vector<TerrainSpan>> columns;
+	std::vector<TerrainSpan> carved;	// scratch for carve_crater()
+	unsigned revision = 0;
+
+	// Index of the first span of col that covers row y or lies below it
+	static size_t first_ending_after(const std::vector<TerrainSpan>& col, int y) {
+		return std::upper_bound(col.begin(), col.end(), y, [](int y, const TerrainSpan& s) { return y < s.y1; }) - col.begin();
+	}
+
+public:
+	void create(int width, int height, TerrainType fill = SKY) {
+		assert(height <= UINT16_MAX);
+		this->width = width;
+		this->height = height;
+		columns.assign(width, {});
+		if (fill != SKY) {
+			for (auto& col : columns) col.push_back({ 0, (uint16_t)height, fill });
+		}
+		revision++;
+	}
+
+	// Copies a dense terrain, reading it a row at a time
+	void assign(const Terrain& terrain) {
+		create(terrain.get_width(), terrain.get_height());
+		std::vector<uint8_t> row(width);
+		for (int y = 0; y < height; y++) {
+			terrain.decode_row(y, 0, width, row.data());
+			for (int x = 0; x < width; x++) {
+				TerrainType type = (TerrainType)row[x];
+				if (type == SKY) continue;
+				auto& col = columns[x];
+				if (!col.empty() && col.back().y1 == y && col.back().type == type) col.back().y1++;
+				else col.push_back({ (uint16_t)y, (uint16_t)(y + 1), type });
+			}
+		}
+		for (auto& col : columns) col.shrink_to_fit();
+	}
+
+	int get_width() const { return width; }
+	int get_height() const { return height; }
+
+	bool in_bounds(int x, int y) const {
+		return x >= 0 && x < width && y >= 0 && y < height;
+	}
+
+	TerrainType get(int x, int y) const {
+		const auto& col = columns[x];
+		size_t i = first_ending_after(col, y);
+		return i < col.size() && col[i].y0 <= y ? col[i].type : SKY;
+	}
+
+	const MaterialProperties& material(int x, int y) const {
+		return material_table[get(x, y)];
+	}
+
+	bool is_solid(int x, int y) const {
+		return material_table[get(x, y)].solid;
+	}
+
+	float friction(int x, int y) const {
+		return material_table[get(x, y)].friction;
+	}
+
+	float density(int x, int y) const {
+		return material_table[get(x, y)].density;
+	}
+
+	// Unpacks count cells of row y, starting at column x, one TerrainType byte each
+	void decode_row(int y, int x, int count, uint8_t* out) const {
+		for (int i = 0; i < count; i++) out[i] = get(x + i, y);
+	}
+
+	const std::vector<TerrainSpan>& get_column(int x) const { return columns[x]; }
+
+	// Sets the cells y0 up to but not including y1 of column x to type, merging equal neighbours
+	void fill(int x, int y0, int y1, TerrainType type) {
+		y0 = std::max(0, y0);
+		y1 = std::min(height, y1);
+		if (y0 >= y1) return;
+		auto& col = columns[x];
+		size_t first = first_ending_after(col, y0);
+		size_t last = first;
+		while (last < col.size() && col[last].y0 < y1) last++;
+
+		TerrainSpan pieces[3];
+		int n = 0;
+		if (first < last && col[first].y0 < y0) pieces[n++] = { col[first].y0, (uint16_t)y0, col[first].type };
+		if (type != SKY) pieces[n++] = { (uint16_t)y0, (uint16_t)y1, type };
+		if (first < last && col[last - 1].y1 > y1) pieces[n++] = { (uint16_t)y1, col[last - 1].y1, col[last - 1].type };
+		col.erase(col.begin() + first, col.begin() + last);
+		col.insert(col.begin() + first, pieces, pieces + n);
+
+		size_t end = std::min(col.size(), first + n + 1);
+		for (size_t i = first ? first - 1 : 0; i + 1 < end;) {
+			if (col[i].y1 == col[i + 1].y0 && col[i].type == col[i + 1].type) {
+				col[i].y1 = col[i + 1].y1;
+				col.erase(col.begin() + i + 1);
+				end--;
+			}
+			else {
+				i++;
+			}
+		}
+	}
+
+	void set(int x, int y, TerrainType type) { fill(x, y, y + 1, type); }
+
+	// Same crater as Terrain::carve_crater(), cut a span at a time: in each column only the part
+	// of every span within its material's reach is cleared.
+	void carve_crater(const olc::vf2d& pos, float radius) {
+		float reach2[16];
+		for (int m = 0; m < 16; m++) {
+			float reach = radius / material_table[m].hardness;
+			reach2[m] = reach * reach;
+		}
+		float box = crater_reach(radius);
+		int x0 = std::max(0, (int)(pos.x - box));
+		int y0 = std::max(0, (int)(pos.y - box));
+		int x1 = std::min(width - 1, (int)(pos.x + box));
+		int y1 = std::min(height - 1, (int)(pos.y + box));
+		for (int x = x0; x <= x1; x++) {
+			float dx = x - pos.x;
+			carved.clear();
+			for (const TerrainSpan& s : columns[x]) {
+				if (s.y1 <= y0) continue;
+				if (s.y0 > y1) break;
+				float left = reach2[s.type] - dx * dx;
+				if (left <= 0) continue;
+				// Estimate the rows from the circle, then settle them with the same test as a per cell carve
+				float h = std::sqrt(left);
+				int lo = std::max((int)s.y0, y0);
+				int hi = std::min((int)s.y1 - 1, y1);
+				int a = std::clamp((int)std::floor(pos.y - h), lo, hi);
+				int b = std::clamp((int)std::ceil(pos.y + h), lo, hi);
+				auto inside = [&](int y) { float dy = y - pos.y; return dx * dx + dy * dy < reach2[s.type]; };
+				while (a > lo && inside(a - 1)) a--;
+				while (b < hi && inside(b + 1)) b++;
+				while (a <= b && !inside(a)) a++;
+				while (b >= a && !inside(b)) b--;
+				if (a <= b) carved.push_back({ (uint16_t)a, (uint16_t)(b + 1), SKY });
+			}
+			for (const TerrainSpan& c : carved) fill(x, c.y0, c.y1, SKY);
+		}
+		revision++;
+	}
+
+	// Edits through fill() and set() are picked up by everything reading the spans; this only
+	// bumps the revision, for callers that cache against it.
+	void refresh(int /*x0*/, int /*y0*/, int /*x1*/, int /*y1*/) { revision++; }
+
+	unsigned get_revision() const { return revision; }
+
+	bool changed_since(unsigned since, int /*x0*/, int /*y0*/, int /*x1*/, int /*y1*/) const { return since != revision; }
+
+	size_t memory_bytes() const {
+		size_t bytes = columns.capacity() * sizeof(columns[0]);
+		for (const auto& col : columns) bytes += col.capacity() * sizeof(TerrainSpan);
+		return bytes;
+	}
+
+	// Draws the map from (src_x, src_y) on. Works through bands of band_rows rows, and within a band
+	// a column at a time in a single pass over its sky gaps and the spans in view; the band keeps
+	// the rows a column writes to in cache for the columns next to it.
+	// Textured materials are drawn in their flat colour.
+	void blit(olc::Sprite& target, const Palette& palette, int src_x, int src_y, olc::Pixel fill = olc::BLACK) const {
+		for (int y = 0; y < target.height; y += band_rows) {
+			blit_band(target, palette, src_x, src_y, y, std::min(target.height, y + band_rows), fill);
+		}
+	}
+
+private:
+	static constexpr int band_rows = 16;
+
+	void blit_band(olc::Sprite& target, const Palette& palette, int src_x, int src_y, int band_top, int band_bottom, olc::Pixel fill) const {
+		olc::Pixel* dst = target.GetData();
+		const int stride = target.width;
+		auto fill_column = [&](int tx, int a, int b, olc::Pixel color) {
+			olc::Pixel* p = dst + a * stride + tx;
+			for (int y = a; y < b; y++, p += stride) *p = color;
+		};
+		olc::Pixel sky = palette.get(SKY);
+		int top = std::clamp(-src_y, band_top, band_bottom);
+		int bottom = std::clamp(height - src_y, top, band_bottom);
+		for (int tx = 0; tx < target.width; tx++) {
+			int x = src_x + tx;
+			if (x < 0 || x >= width) {
+				fill_column(tx, band_top, band_bottom, fill);
+				continue;
+			}
+			fill_column(tx, band_top, top, fill);
+			const auto& col = columns[x];
+			int y = top;
+			for (size_t i = first_ending_after(col, src_y + top); i < col.size() && y < bottom; i++) {
+				int a = std::max((int)col[i].y0 - src_y, y);
+				int b = std::min((int)col[i].y1 - src_y, bottom);
+				fill_column(tx, y, std::min(a, bottom), sky);
+				if (a < b) fill_column(tx, a, b, palette.get(col[i].type));
+				y = std::max(y, b);
+			}
+			fill_column(tx, y, bottom, sky);
+			fill_column(tx, bottom, band_bottom, fill);
+		}
+	}
+};
@@ -0,0 +1,87 @@
+#pragma once
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <algorithm>
+
+// Chunk membership of every entity, kept separately per entity kind so lookups stay typed.
+// Rebuilt from scratch with a counting sort whenever the entity arrays change; the buffers are
+// reused, so a rebuild does not allocate once they have grown to the entity count.
+template <int Kinds>
+class SpatialGrid {
+	struct KindIndex {
+		std::vector<uint32_t> start;	// first entry of each chunk, plus an end marker
+		std::vector<uint32_t> entries;	// entity indices sorted by chunk
+		std::vector<uint32_t> chunk_of;	// scratch, chunk of each entity
+	};
+
+	int chunk_shift = 6;
+	int chunks_x = 0;
+	int chunks_y = 0;
+	std::array<KindIndex, Kinds> kinds;
+
+	int chunk_at(float x, float y) const {
+		int cx = std::clamp((int)x >> chunk_shift, 0, chunks_x - 1);
+		int cy = std::clamp((int)y >> chunk_shift, 0, chunks_y - 1);
+		return cy * chunks_x + cx;
+	}
+
+public:
+	void resize(int width, int height, int chunk_shift = 6) {
+		this->chunk_shift = chunk_shift;
+		chunks_x = std::max(1, (width + (1 << chunk_shift) - 1) >> chunk_shift);
+		chunks_y = std::max(1, (height + (1 << chunk_shift) - 1) >> chunk_shift);
+		for (auto& k : kinds) {
+			k.start.assign(chunks_x * chunks_y + 1, 0);
+			k.entries.clear();
+		}
+	}
+
+	int get_chunks_x() const { return chunks_x; }
+	int get_chunks_y() const { return chunks_y; }
+	int get_chunk_size() const { return 1 << chunk_shift; }
+
+	// Files every item of one kind under the chunk containing its pos
+	template <class T>
+	void build(int kind, const std::vector<T>& items) {
+		KindIndex& k = kinds[kind];
+		std::fill(k.start.begin(), k.start.end(), 0);
+		k.chunk_of.resize(items.size());
+		k.entries.resize(items.size());
+		for (size_t i = 0; i < items.size(); i++) {
+			int c = chunk_at(items[i].pos.x, items[i].pos.y);
+			k.chunk_of[i] = c;
+			k.start[c + 1]++;
+		}
+		for (size_t c = 1; c < k.start.size(); c++) {
+			k.start[c] += k.start[c - 1];
+		}
+		for (size_t i = 0; i < items.size(); i++) {
+			k.entries[k.start[k.chunk_of[i]]++] = (uint32_t)i;
+		}
+		// The fill pass advanced every start to the next chunk's; shift them back
+		for (size_t c = k.start.size() - 1; c > 0; c--) {
+			k.start[c] = k.start[c - 1];
+		}
+		k.start[0] = 0;
+	}
+
+	// Calls fn(index) for every entity of the kind filed in a chunk overlapping [x0, x1) x [y0, y1)
+	template <class Fn>
+	void query(int kind, int x0, int y0, int x1, int y1, Fn fn) const {
+		const KindIndex& k = kinds[kind];
+		if (k.start.empty()) return;
+		int cx0 = std::clamp(x0 >> chunk_shift, 0, chunks_x - 1);
+		int cy0 = std::clamp(y0 >> chunk_shift, 0, chunks_y - 1);
+		int cx1 = std::clamp((x1 - 1) >> chunk_shift, 0, chunks_x - 1);
+		int cy1 = std::clamp((y1 - 1) >> chunk_shift, 0, chunks_y - 1);
+		for (int cy = cy0; cy <= cy1; cy++) {
+			// Chunks of a row are contiguous, so one row is a single run of entries
+			uint32_t begin = k.start[cy * chunks_x + cx0];
+			uint32_t end = k.start[cy * chunks_x + cx1 + 1];
+			for (uint32_t e = begin; e < end; e++) {
+				fn(k.entries[e]);
+			}
+		}
+	}
+};
@@ -0,0 +1,125 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "olcPixelGameEngine.h"
+#include "atlas.h"
+
+// Collects sprite quads per decal and submits them as triangle lists of up to 21 quads, so a
+// frame costs one decal instance per 21 sprites of a texture instead of one per object. With
+// every sprite in the Atlas all entities share those submissions.
+// Quads that end up entirely outside the screen are dropped before they are stored.
+class SpriteBatch {
+	struct Batch {
+		olc::Decal* decal = nullptr;
+		std::vector<olc::vf2d> pos;
+		std::vector<olc::vf2d> uv;
+		std::vector<olc::Pixel> tint;
+	};
+
+	olc::PixelGameEngine* canvas = nullptr;
+	std::vector<Batch> batches;
+	olc::vf2d screen_size;
+	float view_scale = 1;
+	int drawn = 0;
+	int culled = 0;
+
+	Batch& batch_for(olc::Decal* decal) {
+		for (auto& b : batches) {
+			if (b.decal == decal) return b;
+		}
+		batches.emplace_back();
+		batches.back().decal = decal;
+		return batches.back();
+	}
+
+	// Corners in the same order as PixelGameEngine::DrawDecal: top left, bottom left, bottom right, top right
+	void add_quad(const AtlasSprite& sprite, olc::vf2d* corners, const olc::Pixel& tint) {
+		for (int i = 0; i < 4; i++) {
+			corners[i] *= view_scale;
+		}
+		olc::vf2d lo = corners[0];
+		olc::vf2d hi = corners[0];
+		for (int i = 1; i < 4; i++) {
+			lo = lo.min(corners[i]);
+			hi = hi.max(corners[i]);
+		}
+		if (hi.x < 0 || hi.y < 0 || lo.x > screen_size.x || lo.y > screen_size.y) {
+			culled++;
+			return;
+		}
+		drawn++;
+
+		static const olc::vf2d quad_uv[4] = { { 0.0f, 0.0f }, { 0.0f, 1.0f }, { 1.0f, 1.0f }, { 1.0f, 0.0f } };
+		static const int order[6] = { 0, 1, 2, 0, 2, 3 };
+		Batch& b = batch_for(sprite.decal);
+		for (int i : order) {
+			b.pos.push_back(corners[i]);
+			b.uv.push_back(sprite.uv_pos + quad_uv[i] * sprite.uv_size);
+			b.tint.push_back(tint);
+		}
+	}
+
+public:
+	// Starts a frame. Buffers keep their capacity, so steady state frames do not allocate here.
+	// Every quad is scaled by view_scale around the screen origin, which zooms the whole batch.
+	void begin(olc::PixelGameEngine& canvas, float view_scale = 1) {
+		this->canvas = &canvas;
+		this->view_scale = view_scale;
+		screen_size = canvas.GetScreenSize();
+		for (auto& b : batches) {
+			b.pos.clear();
+			b.uv.clear();
+			b.tint.clear();
+		}
+		drawn = 0;
+		culled = 0;
+	}
+
+	// Same placement as PixelGameEngine::DrawDecal
+	void add(const AtlasSprite& sprite, const olc::vf2d& pos, const olc::vf2d& scale, const olc::Pixel& tint = olc::WHITE) {
+		if (!sprite) return;
+		olc::vf2d size = sprite.size * scale;
+		olc::vf2d corners[4] = { pos, { pos.x, pos.y + size.y }, pos + size, { pos.x + size.x, pos.y } };
+		add_quad(sprite, corners, tint);
+	}
+
+	// Same placement as PixelGameEngine::DrawRotatedDecal
+	void add_rotated(const AtlasSprite& sprite, const olc::vf2d& pos, float angle, const olc::vf2d& center, const olc::vf2d& scale, const olc::Pixel& tint = olc::WHITE) {
+		if (!sprite) return;
+		float w = sprite.size.x;
+		float h = sprite.size.y;
+		olc::vf2d corners[4] = {
+			(olc::vf2d(0.0f, 0.0f) - center) * scale,
+			(olc::vf2d(0.0f, h) - center) * scale,
+			(olc::vf2d(w, h) - center) * scale,
+			(olc::vf2d(w, 0.0f) - center) * scale
+		};
+		float c = cosf(angle), s = sinf(angle);
+		for (auto& p : corners) {
+			p = pos + olc::vf2d(p.x * c - p.y * s, p.x * s + p.y * c);
+		}
+		add_quad(sprite, corners, tint);
+	}
+
+	// For the odd debug shape that is not a sprite
+	olc::PixelGameEngine& get_canvas() { return *canvas; }
+	float get_view_scale() const { return view_scale; }
+
+	// The OpenGL 3.3 and Emscripten renderers copy a decal instance into a buffer of OLC_MAX_VERTS
+	// vertices without checking, so each batch goes out in whole quads of at most that many.
+	void flush() {
+		const size_t max_vertices = olc::OLC_MAX_VERTS / 6 * 6;
+		canvas->SetDecalStructure(olc::DecalStructure::LIST);
+		for (auto& b : batches) {
+			for (size_t first = 0; first < b.pos.size(); first += max_vertices) {
+				uint32_t count = (uint32_t)std::min(max_vertices, b.pos.size() - first);
+				canvas->DrawExplicitDecal(b.decal, b.pos.data() + first, b.uv.data() + first, b.tint.data() + first, count);
+			}
+		}
+		canvas->SetDecalStructure(olc::DecalStructure::FAN);
+	}
+
+	int get_drawn() const { return drawn; }
+	int get_culled() const { return culled; }
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "olcPixelGameEngine.h"
+
+// Per column, the y of the topmost solid cell, or the height for a column without any.
+// Edits only rescan the columns they touched, starting at the edited rows: a column whose top
+// lies above an edit keeps it, and one whose top lies below it is only rescanned down to there.
+class SurfaceCache {
+	int width = 0;
+	int height = 0;
+	std::vector<int> top;
+
+public:
+	template <class IsSolid>
+	void build(int width, int height, IsSolid is_solid) {
+		this->width = width;
+		this->height = height;
+		top.assign(width, height);
+		update(0, 0, width - 1, height - 1, is_solid);
+	}
+
+	// Repairs the columns of the inclusive cell rectangle after edits
+	template <class IsSolid>
+	void update(int x0, int y0, int x1, int y1, IsSolid is_solid) {
+		x0 = std::max(0, x0);
+		y0 = std::max(0, y0);
+		x1 = std::min(width - 1, x1);
+		y1 = std::min(height - 1, y1);
+		if (x0 > x1 || y0 > y1) return;
+		for (int x = x0; x <= x1; x++) {
+			int& t = top[x];
+			if (t < y0) continue;
+			int y = y0;
+			while (y <= y1 && !is_solid(x, y)) y++;
+			if (y > y1 && t > y1) continue;
+			while (y < height && !is_solid(x, y)) y++;
+			t = y;
+		}
+	}
+
+	int get_width() const { return width; }
+
+	// Topmost solid y of column x, clamped to the map
+	int get(int x) const {
+		return top[std::clamp(x, 0, width - 1)];
+	}
+
+	// Change of the surface y per column around x, positive where the ground falls away to the right
+	float slope(int x) const {
+		return (get(x + 1) - get(x - 1)) * 0.5f;
+	}
+
+	// Unit vector out of the ground at column x
+	olc::vf2d normal(int x) const {
+		olc::vf2d n = { slope(x), -1.0f };
+		return n / n.mag();
+	}
+};
@@ -0,0 +1,221 @@
+#pragma once
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include "olcPixelGameEngine.h"
+#include "occupancy.h"
+#include "surface.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TERRAIN_SSE2 1
+#endif
+
+// Cell material. Stored in 4 bits, so there is room for 16; the value doubles as the palette index.
+enum TerrainType : uint8_t {
+	SKY,
+	DIRT,
+	ROCK,
+	BEDROCK,
+	SAND,
+	WATER,
+};
+
+struct MaterialProperties {
+	bool solid;
+	bool granular;	// loose grains that fall and pile up, see FallingSand
+	float hardness;	// divides boom() radius, INFINITY for indestructible
+	float friction;	// multiplies an object's own friction when it bounces off the material
+	float density;	// of a fluid, buoys up and slows down objects inside it
+	olc::Pixel color;
+};
+
+// Indexed by TerrainType. Every 4 bit value has an entry, so lookups need no range check.
+inline const MaterialProperties material_table[16] = {
+	{ false, false, INFINITY, 1.0f, 0.0f, olc::BLUE },	// SKY
+	{ true, false, 1.0f, 1.0f, 0.0f, olc::GREEN },	// DIRT
+	{ true, false, 2.0f, 1.15f, 0.0f, olc::Pixel(110, 110, 120) },	// ROCK
+	{ true, false, INFINITY, 1.15f, 0.0f, olc::Pixel(40, 40, 48) },	// BEDROCK
+	{ true, true, 0.7f, 0.6f, 0.0f, olc::Pixel(220, 200, 120) },	// SAND
+	{ false, false, INFINITY, 1.0f, 1.0f, olc::Pixel(40, 90, 220) },	// WATER
+};
+
+// How far a crater of the given radius reaches into the softest material; carving and the
+// areas woken after it have to cover this much, not just the radius
+inline float crater_reach(float radius) {
+	static const float softest = [] {
+		float h = INFINITY;
+		for (const MaterialProperties& m : material_table) {
+			if (m.hardness > 0) h = std::min(h, m.hardness);
+		}
+		return h;
+	}();
+	return radius / softest;
+}
+
+// An inclusive cell rectangle touched by an edit, tagged with the revision it produced
+struct TerrainEdit {
+	unsigned revision = 0;
+	int x0 = 0;
+	int y0 = 0;
+	int x1 = -1;
+	int y1 = -1;
+};
+
+// Two cells per byte, the even x in the low nibble. Rows are padded to whole bytes.
+class Terrain {
+	static constexpr int edit_log_size = 64;
+
+	int width = 0;
+	int height = 0;
+	int stride = 0;	// bytes per row
+	std::vector<uint8_t> cells;
+	OccupancyPyramid occupancy;
+	SurfaceCache surface;
+
+	unsigned revision = 0;
+	std::array<TerrainEdit, edit_log_size> edit_log;
+
+	void log_edit(int x0, int y0, int x1, int y1) {
+		revision++;
+		edit_log[revision % edit_log_size] = { revision, x0, y0, x1, y1 };
+	}
+
+public:
+	void create(int width, int height, TerrainType fill = SKY) {
+		this->width = width;
+		this->height = height;
+		stride = (width + 1) / 2;
+		cells.assign(stride * height, (uint8_t)(fill | fill << 4));
+		rebuild();
+	}
+
+	int get_width() const { return width; }
+	int get_height() const { return height; }
+
+	bool in_bounds(int x, int y) const {
+		return x >= 0 && x < width && y >= 0 && y < height;
+	}
+
+	TerrainType get(int x, int y) const {
+		return (TerrainType)((cells[y * stride + (x >> 1)] >> ((x & 1) << 2)) & 0x0F);
+	}
+
+	const MaterialProperties& material(int x, int y) const {
+		return material_table[get(x, y)];
+	}
+
+	bool is_solid(int x, int y) const {
+		return material_table[get(x, y)].solid;
+	}
+
+	float friction(int x, int y) const {
+		return material_table[get(x, y)].friction;
+	}
+
+	float density(int x, int y) const {
+		return material_table[get(x, y)].density;
+	}
+
+	// Unpacks count cells of row y, starting at column x, one TerrainType byte each
+	void decode_row(int y, int x, int count, uint8_t* out) const {
+		const uint8_t* row = cells.data() + y * stride;
+		int i = 0;
+		if ((x & 1) && count > 0) {
+			out[i++] = row[x >> 1] >> 4;
+		}
+		const uint8_t* packed = row + ((x + i) >> 1);
+#ifdef TERRAIN_SSE2
+		const __m128i low_bits = _mm_set1_epi8(0x0F);
+		for (; i + 16 <= count; i += 16, packed += 8) {
+			__m128i v = _mm_loadl_epi64((const __m128i*)packed);
+			__m128i lo = _mm_and_si128(v, low_bits);
+			__m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low_bits);
+			_mm_storeu_si128((__m128i*)(out + i), _mm_unpacklo_epi8(lo, hi));
+		}
+#endif
+		for (; i + 2 <= count; i += 2, packed++) {
+			out[i] = *packed & 0x0F;
+			out[i + 1] = *packed >> 4;
+		}
+		if (i < count) {
+			out[i] = *packed & 0x0F;
+		}
+	}
+
+	// Writes a single cell. Call refresh() over the edited area afterwards to keep the occupancy pyramid in sync.
+	void set(int x, int y, TerrainType type) {
+		uint8_t& b = cells[y * stride + (x >> 1)];
+		int shift = (x & 1) << 2;
+		b = (uint8_t)((b & ~(0x0F << shift)) | (type << shift));
+	}
+
+	// Clears every cell closer to pos than radius divided by the hardness of its material, then
+	// refreshes the area
+	void carve_crater(const olc::vf2d& pos, float radius) {
+		float reach2[16];
+		for (int m = 0; m < 16; m++) {
+			float reach = radius / material_table[m].hardness;
+			reach2[m] = reach * reach;
+		}
+		float box = crater_reach(radius);
+		int x0 = std::max(0, (int)(pos.x - box));
+		int y0 = std::max(0, (int)(pos.y - box));
+		int x1 = std::min(width - 1, (int)(pos.x + box));
+		int y1 = std::min(height - 1, (int)(pos.y + box));
+		for (int y = y0; y <= y1; y++) {
+			float dy = y - pos.y;
+			for (int x = x0; x <= x1; x++) {
+				float dx = x - pos.x;
+				if (dx * dx + dy * dy < reach2[get(x, y)]) {
+					set(x, y, SKY);
+				}
+			}
+		}
+		refresh(x0, y0, x1, y1);
+	}
+
+	// Re-evaluates the occupancy and surface of the inclusive cell rectangle after edits.
+	void refresh(int x0, int y0, int x1, int y1) {
+		occupancy.update(x0, y0, x1, y1, [&](int x, int y) { return is_solid(x, y); });
+		surface.update(x0, y0, x1, y1, [&](int x, int y) { return is_solid(x, y); });
+		log_edit(x0, y0, x1, y1);
+	}
+
+	void rebuild() {
+		occupancy.build(width, height, [&](int x, int y) { return is_solid(x, y); });
+		surface.build(width, height, [&](int x, int y) { return is_solid(x, y); });
+		log_edit(0, 0, width - 1, height - 1);
+	}
+
+	// Bumped by every refresh() and rebuild(). Caches remember it to find out what changed since.
+	unsigned get_revision() const { return revision; }
+
+	// Calls fn(edit) for each edit made after revision since, oldest first.
+	// Returns false without calling fn if some of those edits already fell out of the log,
+	// in which case the caller has to treat the whole map as changed.
+	template <class Fn>
+	bool for_each_edit_since(unsigned since, Fn fn) const {
+		if (revision - since > (unsigned)edit_log_size) return false;
+		for (unsigned r = since + 1; r <= revision; r++) {
+			fn(edit_log[r % edit_log_size]);
+		}
+		return true;
+	}
+
+	// True if any edit after revision since touched the inclusive rectangle
+	bool changed_since(unsigned since, int x0, int y0, int x1, int y1) const {
+		bool changed = false;
+		bool complete = for_each_edit_since(since, [&](const TerrainEdit& e) {
+			if (e.x0 <= x1 && e.x1 >= x0 && e.y0 <= y1 && e.y1 >= y0) changed = true;
+		});
+		return changed || !complete;
+	}
+
+	size_t memory_bytes() const { return cells.capacity(); }
+
+	const OccupancyPyramid& get_occupancy() const { return occupancy; }
+	const SurfaceCache& get_surface() const { return surface; }
+};
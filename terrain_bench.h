@@ -0,0 +1,121 @@
+#pragma once
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include "olcPixelGameEngine.h"
+#include "world.h"
+#include "span_terrain.h"
+#include "terrain_image.h"
+
+// Runs the dense Terrain and SpanTerrain side by side on generated maps of a normal, a very tall
+// and a very wide size: memory, random point queries, craters along the surface and drawing a
+// 1280x720 view. Both backends carve the same craters and are compared cell by cell afterwards.
+// The dense carve includes its occupancy, surface and edit log upkeep, which the spans do without.
+// Started with --bench-terrain.
+inline void run_terrain_benchmark(std::ostream& out) {
+	struct MapSize {
+		const char* name;
+		int width;
+		int height;
+	};
+	const MapSize sizes[] = { { "normal", 1024, 512 }, { "tall", 1024, 16384 }, { "wide", 32768, 512 } };
+	const int queries = 1 << 20;
+	const int craters = 500;
+
+	using clock = std::chrono::steady_clock;
+	auto elapsed_ms = [](clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	};
+
+	for (const MapSize& size : sizes) {
+		World world(1);
+		world.generate_terrain(size.width, size.height);
+		Terrain& dense = world.terrain;
+		SpanTerrain spans;
+		spans.assign(dense);
+
+		std::mt19937 rng(7);
+		std::vector<olc::vi2d> points(queries);
+		for (auto& p : points) p = { (int)(rng() % size.width), (int)(rng() % size.height) };
+		int dense_hits = 0, span_hits = 0;
+		auto start = clock::now();
+		for (const auto& p : points) dense_hits += dense.is_solid(p.x, p.y);
+		double dense_query = elapsed_ms(start);
+		start = clock::now();
+		for (const auto& p : points) span_hits += spans.is_solid(p.x, p.y);
+		double span_query = elapsed_ms(start);
+
+		std::vector<olc::vf2d> centers(craters);
+		for (auto& c : centers) {
+			int x = rng() % size.width;
+			c = { (float)x, (float)(dense.get_surface().get(x) + (int)(rng() % 60) - 20) };
+		}
+		start = clock::now();
+		for (const auto& c : centers) dense.carve_crater(c, 20);
+		double dense_carve = elapsed_ms(start);
+		start = clock::now();
+		for (const auto& c : centers) spans.carve_crater(c, 20);
+		double span_carve = elapsed_ms(start);
+
+		int mismatches = 0;
+		std::vector<uint8_t> a(size.width), b(size.width);
+		for (int y = 0; y < size.height; y++) {
+			dense.decode_row(y, 0, size.width, a.data());
+			spans.decode_row(y, 0, size.width, b.data());
+			for (int x = 0; x < size.width; x++) mismatches += a[x] != b[x];
+		}
+
+		olc::Sprite target(1280, 720);
+		TerrainImage image;
+		image.update(dense);
+		const int frames = 20;
+		start = clock::now();
+		for (int f = 0; f < frames; f++) {
+			int x = dense.get_width() / 2 - 640 + f;
+			image.blit(target, dense, 0, x, dense.get_surface().get(x + 640) - 360);
+		}
+		double dense_blit = elapsed_ms(start) / frames;
+		start = clock::now();
+		for (int f = 0; f < frames; f++) {
+			int x = dense.get_width() / 2 - 640 + f;
+			spans.blit(target, image.get_palette(), x, dense.get_surface().get(x + 640) - 360);
+		}
+		double span_blit = elapsed_ms(start) / frames;
+
+		out << size.name << ' ' << size.width << 'x' << size.height << ": memory dense " << dense.memory_bytes()
+			<< " B, spans " << spans.memory_bytes() << " B (" << (double)dense.memory_bytes() / spans.memory_bytes() << "x)\n"
+			<< "\tquery  dense " << dense_query * 1e6 / queries << " ns, spans " << span_query * 1e6 / queries
+			<< " ns (solid " << dense_hits << " / " << span_hits << ")\n"
+			<< "\tcrater dense " << dense_carve * 1e3 / craters << " us, spans " << span_carve * 1e3 / craters << " us\n"
+			<< "\tblit   dense " << dense_blit << " ms, spans " << span_blit << " ms\n"
+			<< "\tcells that differ after the craters: " << mismatches << '\n';
+	}
+
+	// A crater in the softest material reaches past the radius and has to come out round there
+	// too: every cell within reach cleared, none beyond it
+	const int block = 128;
+	const float radius = 20;
+	const olc::vf2d center = { block / 2.0f, block / 2.0f };
+	float reach = radius / material_table[SAND].hardness;
+	Terrain dense;
+	dense.create(block, block, SAND);
+	dense.carve_crater(center, radius);
+	SpanTerrain spans;
+	spans.create(block, block, SAND);
+	spans.carve_crater(center, radius);
+	int wrong_dense = 0, wrong_spans = 0, inside = 0;
+	for (int y = 0; y < block; y++) {
+		for (int x = 0; x < block; x++) {
+			olc::vf2d d = olc::vf2d((float)x, (float)y) - center;
+			bool cleared = d.mag2() < reach * reach;
+			inside += cleared;
+			wrong_dense += (dense.get(x, y) == SKY) != cleared;
+			wrong_spans += (spans.get(x, y) == SKY) != cleared;
+		}
+	}
+	out << "sand crater, radius " << radius << " reaching " << reach << ": " << inside << " cells within reach, "
+		<< wrong_dense << " dense and " << wrong_spans << " span cells off the circle"
+		<< (wrong_dense || wrong_spans ? " FAILED\n" : "\n");
+}
@@ -0,0 +1,169 @@
+#pragma once
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include "olcPixelGameEngine.h"
+#include "terrain.h"
+#include "palette.h"
+#include "alloc_tracker.h"
+
+// The terrain as a colour image plus a mip chain, level k being 1 / 2^k the size of the map.
+// A view zoomed out by 2^k reads level k 1:1, so drawing it always touches one texel per screen
+// pixel no matter how much of the map is visible.
+// Level 0 is not stored: its rows are decoded from the terrain's packed cells and expanded through the
+// palette, straight into the draw target or into the scratch rows level 1 is averaged from.
+// update() follows the terrain's edit log and only re-averages the halved edited rectangles of
+// each coarser level.
+class TerrainImage {
+	struct Level {
+		int width = 0;
+		int height = 0;
+		std::vector<olc::Pixel> pixels;
+	};
+
+	std::vector<Level> levels;
+	unsigned revision = 0;
+	Palette palette;
+	std::vector<olc::Pixel> scratch[2];
+
+	void build(const Terrain& terrain) {
+		ALLOC_ALLOWED_SCOPE();
+		levels.clear();
+		int w = terrain.get_width();
+		int h = terrain.get_height();
+		while (true) {
+			Level l;
+			l.width = w;
+			l.height = h;
+			if (!levels.empty()) l.pixels.resize(w * h);
+			levels.push_back(std::move(l));
+			if (w == 1 && h == 1) break;
+			w = std::max(1, (w + 1) / 2);
+			h = std::max(1, (h + 1) / 2);
+		}
+		// Sized for the widest possible edit, so later refreshes never allocate
+		scratch[0].resize(terrain.get_width() + 2);
+		scratch[1].resize(terrain.get_width() + 2);
+		refresh(terrain, 0, 0, terrain.get_width() - 1, terrain.get_height() - 1);
+	}
+
+	// Decodes the packed cells in slices small enough for the stack, then expands each through the palette
+	void expand_terrain_row(const Terrain& terrain, int x, int y, int count, olc::Pixel* out) const {
+		const int slice = 256;
+		uint8_t materials[slice];
+		for (int i = 0; i < count; i += slice) {
+			int n = std::min(slice, count - i);
+			terrain.decode_row(y, x + i, n, materials);
+			palette.expand_row(materials, n, x + i, y, out + i);
+		}
+	}
+
+	static olc::Pixel average(const olc::Pixel* p) {
+		return olc::Pixel(
+			(p[0].r + p[1].r + p[2].r + p[3].r) / 4,
+			(p[0].g + p[1].g + p[2].g + p[3].g) / 4,
+			(p[0].b + p[1].b + p[2].b + p[3].b) / 4);
+	}
+
+	// Inclusive rectangle in level 0 texels
+	void refresh(const Terrain& terrain, int x0, int y0, int x1, int y1) {
+		x0 = std::max(x0, 0);
+		y0 = std::max(y0, 0);
+		x1 = std::min(x1, terrain.get_width() - 1);
+		y1 = std::min(y1, terrain.get_height() - 1);
+		if (x0 > x1 || y0 > y1 || levels.size() < 2) return;
+
+		// Level 1 from two expanded terrain rows at a time
+		x0 >>= 1; y0 >>= 1; x1 >>= 1; y1 >>= 1;
+		Level& first = levels[1];
+		int fx0 = x0 * 2;
+		int fx1 = std::min(x1 * 2 + 1, terrain.get_width() - 1);
+		int n = fx1 - fx0 + 1;
+		for (int y = y0; y <= y1; y++) {
+			for (int k = 0; k < 2; k++) {
+				int fy = std::min(y * 2 + k, terrain.get_height() - 1);
+				expand_terrain_row(terrain, fx0, fy, n, scratch[k].data());
+				scratch[k][n] = scratch[k][n - 1];	// odd width, repeat the last texel
+			}
+			for (int x = x0; x <= x1; x++) {
+				int i = (x - x0) * 2;
+				const olc::Pixel p[4] = { scratch[0][i], scratch[0][i + 1], scratch[1][i], scratch[1][i + 1] };
+				first.pixels[y * first.width + x] = average(p);
+			}
+		}
+
+		for (size_t i = 2; i < levels.size(); i++) {
+			const Level& fine = levels[i - 1];
+			Level& coarse = levels[i];
+			x0 >>= 1; y0 >>= 1; x1 >>= 1; y1 >>= 1;
+			for (int y = y0; y <= y1; y++) {
+				int fy0 = y * 2;
+				int fy1 = std::min(fy0 + 1, fine.height - 1);
+				for (int x = x0; x <= x1; x++) {
+					int fx0 = x * 2;
+					int fx1 = std::min(fx0 + 1, fine.width - 1);
+					const olc::Pixel p[4] = {
+						fine.pixels[fy0 * fine.width + fx0], fine.pixels[fy0 * fine.width + fx1],
+						fine.pixels[fy1 * fine.width + fx0], fine.pixels[fy1 * fine.width + fx1]
+					};
+					coarse.pixels[y * coarse.width + x] = average(p);
+				}
+			}
+		}
+	}
+
+public:
+	TerrainImage() {
+		for (int m = 0; m < Palette::size; m++) {
+			palette.set(m, material_table[m].color);
+		}
+	}
+
+	// Takes effect with a full rebuild on the next update()
+	void set_palette(const Palette& palette) {
+		this->palette = palette;
+		levels.clear();
+	}
+
+	const Palette& get_palette() const { return palette; }
+
+	// Brings the image in line with the terrain. Rebuilds everything on a size change or when
+	// more edits were made than the terrain's log holds.
+	void update(const Terrain& terrain) {
+		bool resized = levels.empty() || levels[0].width != terrain.get_width() || levels[0].height != terrain.get_height();
+		if (resized) {
+			build(terrain);
+		}
+		else if (!terrain.for_each_edit_since(revision, [&](const TerrainEdit& e) { refresh(terrain, e.x0, e.y0, e.x1, e.y1); })) {
+			refresh(terrain, 0, 0, terrain.get_width() - 1, terrain.get_height() - 1);
+		}
+		revision = terrain.get_revision();
+	}
+
+	int get_levels() const { return (int)levels.size(); }
+	int get_width(int level) const { return levels[level].width; }
+	int get_height(int level) const { return levels[level].height; }
+	// Only for level 1 and up, level 0 is never stored
+	const olc::Pixel* get_row(int level, int y) const { return levels[level].pixels.data() + y * levels[level].width; }
+
+	// Copies the level's texels starting at (src_x, src_y) row by row into target, expanding
+	// terrain rows through the palette for level 0. Whatever lies outside the level is cleared to fill.
+	void blit(olc::Sprite& target, const Terrain& terrain, int level, int src_x, int src_y, olc::Pixel fill = olc::BLACK) const {
+		const Level& l = levels[level];
+		olc::Pixel* dst = target.GetData();
+		int x0 = std::max(0, -src_x);
+		int x1 = std::min(target.width, l.width - src_x);
+		for (int y = 0; y < target.height; y++) {
+			olc::Pixel* row = dst + y * target.width;
+			int sy = src_y + y;
+			if (sy < 0 || sy >= l.height || x0 >= x1) {
+				std::fill(row, row + target.width, fill);
+				continue;
+			}
+			std::fill(row, row + x0, fill);
+			if (level == 0) expand_terrain_row(terrain, src_x + x0, sy, x1 - x0, row + x0);
+			else memcpy(row + x0, l.pixels.data() + sy * l.width + src_x + x0, (x1 - x0) * sizeof(olc::Pixel));
+			std::fill(row + x1, row + target.width, fill);
+		}
+	}
+};
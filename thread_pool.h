@@ -0,0 +1,117 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+
+// Persistent worker threads for data-parallel loops.
+// The calling thread takes part in the work, so a pool with no workers simply runs everything inline.
+// Calls made while the pool is already busy (including from inside a job) also run inline instead of deadlocking.
+class ThreadPool {
+	std::vector<std::thread> workers;
+	std::atomic<bool> busy{ false };	// a job is being dispatched, set by the thread that runs it
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	const std::function<void(int)>* job = nullptr;
+	int job_chunks = 0;
+	std::atomic<int> next_chunk{ 0 };
+	int active = 0;
+	unsigned generation = 0;
+	bool stopping = false;
+
+	void drain(const std::function<void(int)>& fn, int chunks) {
+		int i;
+		while ((i = next_chunk.fetch_add(1)) < chunks) {
+			fn(i);
+		}
+	}
+
+	void worker_loop() {
+		unsigned seen = 0;
+		while (true) {
+			const std::function<void(int)>* fn;
+			int chunks;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&] { return stopping || generation != seen; });
+				if (stopping) return;
+				seen = generation;
+				fn = job;
+				chunks = job_chunks;
+			}
+			drain(*fn, chunks);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--active == 0) done.notify_one();
+			}
+		}
+	}
+
+public:
+	ThreadPool(int threads = (int)std::thread::hardware_concurrency() - 1) {
+		for (int i = 0; i < threads; i++) {
+			workers.emplace_back([this] { worker_loop(); });
+		}
+	}
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto& t : workers) t.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	int get_threads() const { return (int)workers.size() + 1; }
+
+	// Calls fn(i) once for every i in [0, chunks), spread over the workers and the caller.
+	void run(int chunks, const std::function<void(int)>& fn) {
+		// A nested call sees the flag its own outer call set, so it never waits on itself
+		if (workers.empty() || chunks <= 1 || busy.exchange(true, std::memory_order_acquire)) {
+			for (int i = 0; i < chunks; i++) fn(i);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &fn;
+			job_chunks = chunks;
+			next_chunk = 0;
+			active = (int)workers.size();
+			generation++;
+		}
+		wake.notify_all();
+		drain(fn, chunks);
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			done.wait(lock, [&] { return active == 0; });
+			job = nullptr;
+		}
+		busy.store(false, std::memory_order_release);
+	}
+
+	// Splits [begin, end) into ranges of at most grain elements and calls fn(range_begin, range_end) for each.
+	template <class Fn>
+	void parallel_for(int begin, int end, int grain, Fn fn) {
+		if (end <= begin) return;
+		grain = std::max(1, grain);
+		int chunks = (end - begin + grain - 1) / grain;
+		run(chunks, [&](int chunk) {
+			int b = begin + chunk * grain;
+			fn(b, std::min(end, b + grain));
+		});
+	}
+
+	static ThreadPool& shared() {
+		static ThreadPool pool;
+		return pool;
+	}
+};
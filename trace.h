@@ -0,0 +1,159 @@
+#pragma once
+#include <array>
+#include <vector>
+#include <memory>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <ostream>
+#include <cstdint>
+#include "alloc_tracker.h"
+
+// One begin ('B'), end ('E') or instant ('i') event. name must be a string literal or otherwise outlive the trace.
+struct TraceEvent {
+	const char* name = nullptr;
+	int64_t time_ns = 0;
+	char phase = 'i';
+};
+
+// Ring of the most recent events of one thread. Only its thread writes, so pushing is a plain
+// store plus a release of the new head; readers take a snapshot without stopping the writer.
+class TraceBuffer {
+public:
+	static constexpr uint32_t capacity = 1 << 14;
+
+	uint32_t thread = 0;
+	std::array<TraceEvent, capacity> events;
+	std::atomic<uint64_t> head{ 0 };
+
+	void push(const TraceEvent& e) {
+		uint64_t h = head.load(std::memory_order_relaxed);
+		events[h % capacity] = e;
+		head.store(h + 1, std::memory_order_release);
+	}
+};
+
+// Begin/end events of frame stages, explosions and phase changes, written as Chrome trace JSON
+// (chrome://tracing, Perfetto) so a single bad frame can be inspected.
+// Every thread gets its own TraceBuffer on its first event; the registry lock is only taken then.
+// Buffers are never freed, so a thread that exits does not leave a dangling pointer behind.
+class Tracer {
+	std::atomic<bool> enabled{ false };
+	std::mutex registry;
+	std::vector<std::unique_ptr<TraceBuffer>> buffers;
+	std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+	TraceBuffer& local_buffer() {
+		thread_local TraceBuffer* buffer = nullptr;
+		if (!buffer) {
+			ALLOC_ALLOWED_SCOPE();
+			std::lock_guard<std::mutex> lock(registry);
+			buffers.push_back(std::make_unique<TraceBuffer>());
+			buffer = buffers.back().get();
+			buffer->thread = (uint32_t)buffers.size();
+		}
+		return *buffer;
+	}
+
+	void push(const char* name, char phase) {
+		int64_t t = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+		local_buffer().push({ name, t, phase });
+	}
+
+public:
+	static Tracer& shared() {
+		static Tracer tracer;
+		return tracer;
+	}
+
+	// Microseconds with all three nanosecond digits. Written from integers, since a double at the
+	// stream's default precision loses the fraction after a couple of minutes of uptime.
+	static void write_timestamp(std::ostream& out, int64_t time_ns) {
+		const char digits[4] = { char('0' + time_ns / 100 % 10), char('0' + time_ns / 10 % 10), char('0' + time_ns % 10), 0 };
+		out << time_ns / 1000 << '.' << digits;
+	}
+
+	bool is_enabled() const { return enabled.load(std::memory_order_relaxed); }
+	void set_enabled(bool enabled) { this->enabled = enabled; }
+
+	void begin(const char* name) { push(name, 'B'); }
+	void end(const char* name) { push(name, 'E'); }
+	void instant(const char* name) { push(name, 'i'); }
+
+	// Writes what the buffers currently hold. Best called between frames: events a thread records
+	// while this runs may be cut off.
+	bool write_chrome_json(const std::string& file) {
+		std::lock_guard<std::mutex> lock(registry);
+		std::ofstream out(file);
+		out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		bool first = true;
+		for (auto& b : buffers) {
+			uint64_t head = b->head.load(std::memory_order_acquire);
+			uint64_t begin = head > TraceBuffer::capacity ? head - TraceBuffer::capacity : 0;
+			for (uint64_t i = begin; i < head; i++) {
+				const TraceEvent& e = b->events[i % TraceBuffer::capacity];
+				out << (first ? "" : ",\n") << "{\"name\":\"" << e.name << "\",\"ph\":\"" << e.phase
+					<< "\",\"ts\":";
+				write_timestamp(out, e.time_ns);
+				out << ",\"pid\":1,\"tid\":" << b->thread;
+				if (e.phase == 'i') out << ",\"s\":\"t\"";
+				out << "}";
+				first = false;
+			}
+		}
+		out << "\n]}\n";
+		return (bool)out;
+	}
+};
+
+// Begin and end events around the enclosing block while tracing is on
+class TraceScope {
+	const char* name;
+	bool active;
+
+public:
+	TraceScope(const char* name) : name(name), active(Tracer::shared().is_enabled()) {
+		if (active) Tracer::shared().begin(name);
+	}
+
+	~TraceScope() {
+		if (active) Tracer::shared().end(name);
+	}
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#ifdef WORMS_NO_PROFILER
+#define TRACE_SCOPE(name)
+#define TRACE_INSTANT(name)
+#else
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_INSTANT(name) do { if (Tracer::shared().is_enabled()) Tracer::shared().instant(name); } while (0)
+#endif
+
+// Checks the written timestamps keep their sub-microsecond digits however long the game has been
+// running. Started with --check-trace, which exits with 1 on a failure.
+inline bool check_trace_timestamps(std::ostream& out) {
+	struct Case {
+		int64_t time_ns;
+		const char* expected;
+	};
+	const Case cases[] = {
+		{ 0, "0.000" },
+		{ 1500, "1.500" },
+		{ 200000000123, "200000000.123" },	// 200 s
+		{ 86400000000007, "86400000000.007" },	// a day
+	};
+	bool ok = true;
+	for (const Case& c : cases) {
+		std::ostringstream s;
+		Tracer::write_timestamp(s, c.time_ns);
+		bool pass = s.str() == c.expected;
+		out << (pass ? "ok     " : "FAILED ") << c.time_ns << " ns -> " << s.str() << " us\n";
+		ok &= pass;
+	}
+	return ok;
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <array>
+#include <algorithm>
+#include "olcPixelGameEngine.h"
+#include "physics.h"
+#include "world.h"
+
+// Plain copy of the physics fields of a projectile, cheap enough to simulate on the stack
+struct ProjectileState {
+	olc::vf2d v;
+	olc::vf2d a;
+	olc::vf2d pos;
+	float friction = 0.8f;
+	float buoyancy = 0.8f;
+	float r = 10;
+	int n_bounces = -1;
+	bool dead = false;
+	bool stable = false;
+
+	template <class Obj>
+	static ProjectileState from(const Obj& obj) {
+		ProjectileState s;
+		s.v = obj.v;
+		s.a = obj.a;
+		s.pos = obj.pos;
+		s.friction = obj.friction;
+		s.buoyancy = obj.buoyancy;
+		s.r = obj.r;
+		s.n_bounces = obj.n_bounces;
+		s.dead = obj.dead;
+		s.stable = obj.stable;
+		return s;
+	}
+};
+
+// Runs a projectile through the real integrator until it triggers its bounce death action,
+// leaves the map or comes to rest, without touching the world.
+// The result is cached and only recomputed when the launch state changes or the terrain near
+// the previous path was edited.
+class TrajectoryPredictor {
+public:
+	static constexpr int max_points = 256;
+
+private:
+	std::array<olc::vf2d, max_points> path;
+	int n_points = 0;
+	bool impact = false;
+	olc::vf2d impact_pos;
+
+	// Cache key
+	bool valid = false;
+	ProjectileState launch;
+	unsigned terrain_revision = 0;
+	olc::vi2d bounds_min;
+	olc::vi2d bounds_max;
+
+	float frame_dt = World::step_dt;
+	int substeps = World::substeps;
+	int max_frames = 600;
+
+	static bool same_launch(const ProjectileState& a, const ProjectileState& b) {
+		return a.pos == b.pos && a.v == b.v && a.r == b.r && a.friction == b.friction && a.buoyancy == b.buoyancy && a.n_bounces == b.n_bounces;
+	}
+
+public:
+	// The defaults fly the projectile exactly as World::step() does
+	TrajectoryPredictor(float frame_dt = World::step_dt, int substeps = World::substeps, int max_frames = 600)
+		: frame_dt(frame_dt), substeps(substeps), max_frames(max_frames) {}
+
+	template <class TerrainT>
+	void predict(const TerrainT& terrain, const ProjectileState& start) {
+		if (valid && same_launch(start, launch) &&
+			!terrain.changed_since(terrain_revision, bounds_min.x, bounds_min.y, bounds_max.x, bounds_max.y)) {
+			terrain_revision = terrain.get_revision();
+			return;
+		}
+
+		launch = start;
+		terrain_revision = terrain.get_revision();
+		valid = true;
+		impact = false;
+		n_points = 0;
+
+		ProjectileState s = start;
+		olc::vf2d lo = s.pos;
+		olc::vf2d hi = s.pos;
+		int record_every = std::max(1, max_frames / max_points);
+		for (int frame = 0; frame < max_frames && !s.dead && !s.stable && !impact; frame++) {
+			for (int i = 0; i < substeps; i++) {
+				if (integrate(s, terrain, frame_dt) && count_bounce(s)) {
+					impact = true;
+					impact_pos = s.pos;
+					break;
+				}
+				if (s.dead || s.stable) break;
+			}
+			lo = lo.min(s.pos);
+			hi = hi.max(s.pos);
+			if (frame % record_every == 0 && n_points < max_points) {
+				path[n_points++] = s.pos;
+			}
+		}
+
+		// Terrain edits within reach of the projectile's radius invalidate the path
+		bounds_min = olc::vi2d(lo - olc::vf2d(s.r + 1, s.r + 1));
+		bounds_max = olc::vi2d(hi + olc::vf2d(s.r + 1, s.r + 1));
+	}
+
+	void invalidate() { valid = false; }
+
+	int get_point_count() const { return n_points; }
+	const olc::vf2d& get_point(int i) const { return path[i]; }
+	bool has_impact() const { return impact; }
+	const olc::vf2d& get_impact() const { return impact_pos; }
+};
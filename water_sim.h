@@ -0,0 +1,158 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "terrain.h"
+
+// Sparse liquid simulation over the WATER cells of a Terrain.
+//
+// Only queued cells are looked at: water next to something that changed (wake()) or water that
+// moved last tick. A cell falls, slides diagonally, or steps sideways towards the nearest drop
+// within spread cells on its row; water that cannot go anywhere is dropped from the queue, so a
+// lake at rest costs nothing however wide it is.
+// At most budget cells are processed per tick, the lowest first so falling columns move as a
+// whole. The rest wait for the next tick, which bounds the cost even when a whole lake is released.
+class WaterSimulation {
+public:
+	static constexpr int spread = 8;
+
+private:
+	int width = 0;
+	int height = 0;
+	int budget;
+	std::vector<uint32_t> queue;	// cell indices y * width + x
+	std::vector<uint32_t> next;
+	std::vector<uint64_t> queued;	// one bit per cell, set while the cell is in queue or next
+	unsigned tick = 0;
+	int moved = 0;
+
+	bool is_queued(uint32_t i) const { return (queued[i >> 6] >> (i & 63)) & 1; }
+
+	void enqueue(std::vector<uint32_t>& q, int x, int y) {
+		uint32_t i = (uint32_t)(y * width + x);
+		if (is_queued(i)) return;
+		queued[i >> 6] |= 1ull << (i & 63);
+		q.push_back(i);
+	}
+
+	static bool is_air(const Terrain& terrain, int x, int y) {
+		return terrain.in_bounds(x, y) && terrain.get(x, y) == SKY;
+	}
+
+	// Queues the water around a cell that just emptied, which may now flow into it
+	void wake_neighbours(const Terrain& terrain, int x, int y) {
+		for (int dy = -1; dy <= 0; dy++) {
+			for (int dx = -1; dx <= 1; dx++) {
+				int nx = x + dx, ny = y + dy;
+				if (terrain.in_bounds(nx, ny) && terrain.get(nx, ny) == WATER) enqueue(next, nx, ny);
+			}
+		}
+	}
+
+	// Direction (-1 or 1) of the nearest cell on row y, reachable through air, with air below. 0 if none.
+	int find_drop(const Terrain& terrain, int x, int y, int first_dir) const {
+		for (int d = 1; d <= spread; d++) {
+			for (int dir : { first_dir, -first_dir }) {
+				int nx = x + dir * d;
+				if (!is_air(terrain, nx, y)) continue;
+				if (is_air(terrain, nx, y + 1)) {
+					// Only if the whole way there is open
+					bool open = true;
+					for (int k = 1; k < d && open; k++) open = is_air(terrain, x + dir * k, y);
+					if (open) return dir;
+				}
+			}
+		}
+		return 0;
+	}
+
+public:
+	WaterSimulation(int budget = 4096) : budget(budget) {}
+
+	void resize(int width, int height) {
+		this->width = width;
+		this->height = height;
+		queue.clear();
+		next.clear();
+		queued.assign(((size_t)width * height + 63) / 64, 0);
+	}
+
+	// Queues the water cells within a cell of the inclusive rectangle that have air beside or
+	// below them. Water further in only moves once those have, and is woken by them then.
+	void wake(const Terrain& terrain, int x0, int y0, int x1, int y1) {
+		x0 = std::max(0, x0 - 1);
+		y0 = std::max(0, y0 - 1);
+		x1 = std::min(width - 1, x1 + 1);
+		y1 = std::min(height - 1, y1 + 1);
+		for (int y = y0; y <= y1; y++) {
+			for (int x = x0; x <= x1; x++) {
+				if (terrain.get(x, y) != WATER) continue;
+				if (is_air(terrain, x - 1, y) || is_air(terrain, x + 1, y) || is_air(terrain, x - 1, y + 1) ||
+					is_air(terrain, x, y + 1) || is_air(terrain, x + 1, y + 1)) {
+					enqueue(queue, x, y);
+				}
+			}
+		}
+	}
+
+	// One tick over the queued cells. If anything moved, refreshes the terrain over the inclusive
+	// rectangle that changed and calls on_moved(x0, y0, x1, y1) with it.
+	template <class Fn>
+	void step(Terrain& terrain, Fn on_moved) {
+		moved = 0;
+		if (queue.empty()) return;
+
+		// Lowest cells first, and no more than the budget
+		auto lower = [&](uint32_t a, uint32_t b) { return a > b; };
+		int n = std::min((int)queue.size(), budget);
+		if (n < (int)queue.size()) std::nth_element(queue.begin(), queue.begin() + n, queue.end(), lower);
+		std::sort(queue.begin(), queue.begin() + n, lower);
+
+		int x0 = width, y0 = height, x1 = -1, y1 = -1;
+		next.assign(queue.begin() + n, queue.end());
+		for (int k = 0; k < n; k++) {
+			uint32_t i = queue[k];
+			queued[i >> 6] &= ~(1ull << (i & 63));
+			int x = i % width;
+			int y = i / width;
+			if (terrain.get(x, y) != WATER) continue;
+
+			int dir = ((x + y + tick) & 1) ? 1 : -1;
+			int nx = x, ny = y;
+			if (is_air(terrain, x, y + 1)) {
+				ny = y + 1;
+			}
+			else if (is_air(terrain, x + dir, y + 1) && is_air(terrain, x + dir, y)) {
+				nx = x + dir; ny = y + 1;
+			}
+			else if (is_air(terrain, x - dir, y + 1) && is_air(terrain, x - dir, y)) {
+				nx = x - dir; ny = y + 1;
+			}
+			else if (int side = find_drop(terrain, x, y, dir)) {
+				nx = x + side;
+			}
+			else {
+				continue;	// at rest, goes to sleep
+			}
+
+			terrain.set(x, y, SKY);
+			terrain.set(nx, ny, WATER);
+			enqueue(next, nx, ny);
+			wake_neighbours(terrain, x, y);
+			x0 = std::min(x0, std::min(x, nx));
+			x1 = std::max(x1, std::max(x, nx));
+			y0 = std::min(y0, y);
+			y1 = std::max(y1, ny);
+			moved++;
+		}
+		queue.swap(next);
+		tick++;
+
+		if (moved == 0) return;
+		terrain.refresh(x0, y0, x1, y1);
+		on_moved(x0, y0, x1, y1);
+	}
+
+	int get_queued() const { return (int)queue.size(); }
+	int get_moved() const { return moved; }
+};
@@ -0,0 +1,250 @@
+#pragma once
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include "olcPixelGameEngine.h"
+#include "perlin.h"
+#include "terrain.h"
+#include "physics.h"
+#include "objects.h"
+#include "entity_store.h"
+#include "spatial_grid.h"
+#include "sand_sim.h"
+#include "water_sim.h"
+#include "islands.h"
+#include "profiler.h"
+
+enum Phase {
+	LOADING,
+	RESET,
+	GENERATE_TERRAIN,
+	DEPLOY_TROOPS,
+	DEPLOYING_TROOPS,
+	START_PLAY,
+	CAMERA_MODE
+};
+
+inline const char* phase_name(Phase phase) {
+	static const char* names[] = {
+		"LOADING", "RESET", "GENERATE_TERRAIN", "DEPLOY_TROOPS", "DEPLOYING_TROOPS", "START_PLAY", "CAMERA_MODE"
+	};
+	return names[phase];
+}
+
+using ObjectStore = EntityStore<Dummy, Debris, Missile, Worm>;
+
+// A recent boom(), kept for effects until it is explosion_lifetime seconds old
+struct Explosion {
+	olc::vf2d pos;
+	float radius = 0;
+	float age = 0;
+};
+static_assert(!std::is_polymorphic<Debris>::value && !std::is_polymorphic<Missile>::value && !std::is_polymorphic<Worm>::value,
+	"entity kinds are dispatched statically and must stay free of virtual functions");
+
+// Everything one match simulates: terrain, objects and the turn phase.
+// Has no dependency on a PixelGameEngine instance, so any number of worlds can run side by side.
+class World {
+public:
+	Terrain terrain;
+	ObjectStore objects;
+	SpatialGrid<ObjectStore::kind_count> chunks;
+	FallingSand sand;
+	WaterSimulation water;
+	IslandDetector islands;
+	Phase phase = RESET;
+	std::mt19937 rng;
+	std::vector<Explosion> explosions;
+	static constexpr float explosion_lifetime = 0.6f;
+
+	// The game steps the physics at a fixed rate, so that previews flying the same integrator match
+	static constexpr float step_dt = 1.0f / 60;
+	static constexpr int max_steps_per_frame = 4;	// a slower frame drops the rest of its time
+	static constexpr int substeps = 5;	// integrations per step, each with the full step time
+	static constexpr float explosion_radius = 20;	// of a missile hit
+
+	// Cellular terrain simulation runs at a fixed rate, independent of the frame rate
+	static constexpr float terrain_tick = 1.0f / 60;
+	static constexpr int max_terrain_ticks = 4;	// per step, the rest of a backlog is dropped
+	float terrain_time = 0;
+
+	World(uint32_t seed = 0) : rng(seed) {}
+
+	void generate_terrain(int width, int height) {
+		terrain.create(width, height, SKY);
+		Perlin1D perlin(width);
+		std::uniform_real_distribution<float> unit(0, 1);
+		for (int x = 0; x < width; x++) {
+			perlin.set_seed(x, unit(rng));
+		}
+		perlin.set_seed(0, 0.5);
+		Perlin1D depth_noise(width);
+		for (int x = 0; x < width; x++) {
+			depth_noise.set_seed(x, unit(rng));
+		}
+
+		std::vector<int> surface(width);
+		for (int x = 0; x < width; x++) {
+			surface[x] = perlin.get(x) * height;
+		}
+
+		// Dirt over rock over a bedrock floor. The lowest sixth of the surface is flooded up to the
+		// water line, with sand instead of dirt on its shores.
+		const int bedrock_depth = 4;
+		std::vector<int> sorted = surface;
+		std::nth_element(sorted.begin(), sorted.begin() + width * 5 / 6, sorted.end());
+		const int water_line = sorted[width * 5 / 6];
+		for (int x = 0; x < width; x++) {
+			int h = surface[x];
+			int rock = h + 10 + (int)(depth_noise.get(x) * 30);
+			bool beach = h > water_line - 12;
+			for (int y = h; y < height; y++) {
+				TerrainType type = y < rock ? (beach ? SAND : DIRT) : ROCK;
+				if (y >= height - bedrock_depth) type = BEDROCK;
+				terrain.set(x, y, type);
+			}
+			for (int y = water_line; y < h; y++) {
+				terrain.set(x, y, WATER);
+			}
+		}
+		terrain.rebuild();
+		sand.resize(width, height);
+		water.resize(width, height);
+		islands.resize(width, height);
+	}
+
+	// Carves a crater whose reach into each material is the radius divided by its hardness
+	void boom(const olc::vf2d& expl_pos, float radius) {
+		TRACE_SCOPE("boom");
+		// Debris may grow the entity arrays
+		ALLOC_ALLOWED_SCOPE();
+
+		terrain.carve_crater(expl_pos, radius);
+		explosions.push_back({ expl_pos, radius });
+		float reach = crater_reach(radius);
+		int x0 = std::max(0, (int)(expl_pos.x - reach));
+		int y0 = std::max(0, (int)(expl_pos.y - reach));
+		int x1 = std::min(terrain.get_width() - 1, (int)(expl_pos.x + reach));
+		int y1 = std::min(terrain.get_height() - 1, (int)(expl_pos.y + reach));
+		sand.wake(x0, y0, x1, y1);
+		water.wake(terrain, x0, y0, x1, y1);
+		// Whatever the crater cut loose crumbles
+		islands.check(terrain, x0, y0, x1, y1, [&](int ix0, int iy0, int ix1, int iy1) {
+			sand.wake(ix0, iy0, ix1, iy1);
+		});
+
+		objects.for_each([&](PhysicsObject& obj) {
+			olc::vf2d dir = obj.pos - expl_pos;
+			float div = powf(dir.mag(), 2);
+			if (div < 0.1) div = 0.1f;
+			dir /= div;
+			dir *= radius*radius;
+			obj.v = dir;
+			obj.stable = false;
+		});
+
+		std::uniform_real_distribution<float> spread(-1, 1);
+		for (int i = 0; i < radius*2; i++) {
+			Debris d;
+			d.pos = expl_pos;
+			d.v.x = spread(rng) * radius*2;
+			d.v.y = spread(rng) * radius*2;
+			d.set_size(2.5);
+			objects.add(d);
+		}
+	}
+
+	EntityHandle deploy_troop(const olc::vf2d& pos, int team) {
+		Worm d;
+		d.set_r(Worm::troop_r);
+		d.pos = pos;
+		d.team = team;
+		return objects.add(d);
+	}
+
+	EntityHandle spawn_missile(const olc::vf2d& pos, const olc::vf2d& v) {
+		Missile m;
+		m.pos = pos;
+		m.v = v;
+		return objects.add(m);
+	}
+
+	bool are_all_stable() {
+		bool stable = true;
+		objects.for_each([&](PhysicsObject& obj) {
+			if (!obj.stable) stable = false;
+		});
+		return stable;
+	}
+
+	// Runs the physics for one frame, then the terrain simulation. Objects that die are only flagged, see remove_dead().
+	void step(float dt) {
+		for (int i = 0; i < substeps; i++) {
+			PROFILE_SCOPE(PROFILE_SUBSTEP);
+			NO_ALLOC_SCOPE();
+			objects.for_each_kind([&](auto& items) {
+				// Indexed on purpose: boom() appends debris, which may reallocate items
+				for (size_t k = 0; k < items.size(); k++) {
+					auto& obj = items[k];
+					if (obj.stable) continue;
+
+					if (integrate(obj, terrain, dt) && count_bounce(obj)) {
+						int action = obj.bounce_death_action();
+						if (action == BounceDeathActions::EXPLOSION_LARGE) {
+							olc::vf2d expl_pos = obj.pos;
+							boom(expl_pos, explosion_radius);
+						}
+					}
+				}
+			});
+		}
+		for (Explosion& e : explosions) e.age += dt;
+		explosions.erase(std::remove_if(explosions.begin(), explosions.end(), [](const Explosion& e) { return e.age >= explosion_lifetime; }), explosions.end());
+		simulate_terrain(dt);
+	}
+
+	// Lets loose material settle and water flow. Objects resting where something moved start moving again.
+	void simulate_terrain(float dt) {
+		auto unsettle = [&](int x0, int y0, int x1, int y1) {
+			objects.for_each([&](PhysicsObject& obj) {
+				if (obj.pos.x + obj.r >= x0 && obj.pos.x - obj.r <= x1 + 1 && obj.pos.y + obj.r >= y0 && obj.pos.y - obj.r <= y1 + 1) {
+					obj.stable = false;
+				}
+			});
+		};
+
+		terrain_time += dt;
+		int ticks = 0;
+		for (; terrain_time >= terrain_tick && ticks < max_terrain_ticks; ticks++) {
+			terrain_time -= terrain_tick;
+			{
+				PROFILE_SCOPE(PROFILE_SAND);
+				sand.step(terrain, [&](int x0, int y0, int x1, int y1) {
+					unsettle(x0, y0, x1, y1);
+					// Sinking grains push water up
+					water.wake(terrain, x0, y0, x1, y1);
+				});
+			}
+			PROFILE_SCOPE(PROFILE_WATER);
+			water.step(terrain, unsettle);
+		}
+		if (ticks == max_terrain_ticks) terrain_time = 0;
+	}
+
+	void remove_dead() {
+		objects.remove_dead();
+	}
+
+	// Refiles every object under its chunk. Indices in chunks are only valid until objects change again.
+	void update_chunks() {
+		if (chunks.get_chunks_x() * chunks.get_chunk_size() < terrain.get_width() ||
+			chunks.get_chunks_y() * chunks.get_chunk_size() < terrain.get_height()) {
+			chunks.resize(terrain.get_width(), terrain.get_height());
+		}
+		objects.for_each_kind([&](auto& items) {
+			using T = typename std::decay_t<decltype(items)>::value_type;
+			chunks.build(ObjectStore::kind_of<T>(), items);
+		});
+	}
+};